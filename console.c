@@ -0,0 +1,75 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "encoding.h"
+#include "sbi.h"
+
+#include "console.h"
+
+#define SBI_EXT_DBCN 0x4442434E
+#define CONSOLE_BUFFER_SIZE 512
+
+bool console_has_dbcn;
+
+static char console_buffer[CONSOLE_BUFFER_SIZE];
+static uint64_t console_buffered;
+
+void console_init(void) {
+	struct sbiret dbcn = sbi_probe_extension(SBI_EXT_DBCN);
+	console_has_dbcn = dbcn.error == SBI_SUCCESS && dbcn.value != 0;
+}
+
+// DBCN puede escribir menos de lo pedido, se reintenta con lo que falta.
+// Sin MMU la dirección virtual del buffer es la física.
+static
+long console_flush_locked(void) {
+	uint64_t done = 0;
+	long error = SBI_SUCCESS;
+
+	while (done < console_buffered) {
+		struct sbiret ret = sbi_debug_console_write(console_buffered - done, (unsigned long) &console_buffer[done], 0);
+		if (ret.error != SBI_SUCCESS) {
+			error = ret.error;
+			break;
+		}
+		done += ret.value;
+	}
+	console_buffered = 0;
+	return error;
+}
+
+long console_flush(void) {
+	unsigned long sie = clear_csr(sstatus, SSTATUS_SIE) & SSTATUS_SIE;
+	long error = console_flush_locked();
+	set_csr(sstatus, sie);
+	return error;
+}
+
+long console_write(const char* str, uint64_t len) {
+	if (!console_has_dbcn) {
+		for (uint64_t i = 0; i < len; i++) {
+			long error = sbi_console_putchar(str[i]);
+			if (error != 0) {
+				return error;
+			}
+		}
+		return 0;
+	}
+
+	// Los handlers de interrupciones también imprimen
+	unsigned long sie = clear_csr(sstatus, SSTATUS_SIE) & SSTATUS_SIE;
+	long error = SBI_SUCCESS;
+	bool newline = false;
+	for (uint64_t i = 0; i < len && error == SBI_SUCCESS; i++) {
+		if (console_buffered == CONSOLE_BUFFER_SIZE) {
+			error = console_flush_locked();
+		}
+		console_buffer[console_buffered++] = str[i];
+		newline |= str[i] == '\n';
+	}
+	if (newline && error == SBI_SUCCESS) {
+		error = console_flush_locked();
+	}
+	set_csr(sstatus, sie);
+	return error;
+}
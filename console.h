@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+extern bool console_has_dbcn;
+
+// Probes for the SBI Debug Console extension. Until this runs (or if it's
+// missing) every byte goes out with its own legacy putchar ecall.
+void console_init(void);
+// Line buffered: output is held until a '\n', a full buffer or
+// console_flush. Returns 0 or the SBI error.
+long console_write(const char* str, uint64_t len);
+long console_flush(void);
@@ -1,38 +1,100 @@
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "encoding.h"
+#include "kprintf.h"
 #include "qemu.h"
+#include "spinlock.h"
+#include "trace.h"
 #include "utils.h"
 
 #include "fb.h"
 
 /* See https://github.com/qemu/qemu/blob/master/include/standard-headers/drm/drm_fourcc.h#L192 */
 #define FB_PIXFMT_XRGB8888 0x34325258
+#define FB_PIXFMT_RGB565   0x36314752
+
+#define SSTATUS_VS_INITIAL 0x00000200
+
+#define FB_MAX_WIDTH 1024
+#define FB_MAX_HEIGHT 768
+#define FB_MAX_DAMAGE 32
+#define FB_CURSOR_WIDTH 12
+#define FB_CURSOR_HEIGHT 19
+// Por debajo de esto repartir un relleno cuesta más de lo que se gana
+#define FB_BAND_MIN_PIXELS (64 * 1024)
 
 struct fb_config fb;
+bool fb_has_rvv;
+uint32_t fb_bands = 1;
 
-bool fb_init(void* address, uint32_t width, uint32_t height) {
-	uint16_t fb_selector;
-	uint32_t count;
-	struct {
-		uint32_t size;
-		uint16_t select;
-		uint16_t reserved;
-		char name[56];
-	} file;
-
-	if (fw_cfg_dma_read_from(FW_CFG_FILE_DIR, &count, sizeof(count))) {
-		return false;
+static void fb_parallel_serial(uint32_t count, fb_band_fn fn, void* arg);
+static fb_parallel_fn fb_parallel = fb_parallel_serial;
+
+static uint16_t fb_selector;
+
+// Todo se dibuja acá y fb_present copia a la memoria que QEMU muestra
+static uint64_t fb_back_buffer[FB_MAX_WIDTH * FB_MAX_HEIGHT * 4 / sizeof(uint64_t)];
+
+// Regiones del back buffer que cambiaron desde el último fb_present
+static struct fb_rect fb_damage_list[FB_MAX_DAMAGE];
+static uint32_t fb_damage_count;
+static spinlock_t fb_damage_lock;
+
+// El cursor se dibuja directo en el scanout, nunca en el canvas. Lo que
+// tapa se guarda en `under` para poder borrarlo sin redibujar nada.
+static struct {
+	bool visible;
+	// Hay un cursor en el scanout, en el rect de abajo (ya recortado)
+	bool drawn;
+	uint32_t x, y, width, height;
+	uint32_t under[FB_CURSOR_WIDTH * FB_CURSOR_HEIGHT];
+} fb_cursor;
+
+// Si la extensión V no está implementada sstatus.VS queda fijo en cero, así
+// que intentar activarla nos dice si el hart tiene vectores.
+static
+bool fb_probe_rvv(void) {
+#ifdef __riscv
+	set_csr(sstatus, SSTATUS_VS_INITIAL);
+	return (read_csr(sstatus) & SSTATUS_VS) != 0;
+#else
+	// Compilado para el host (hostbench)
+	return false;
+#endif
+}
+
+bool fb_init(void) {
+	fb.font = fb_font_builtin();
+	fb_has_rvv = fb_probe_rvv();
+
+	fb_selector = 0;
+	return fw_cfg_find_file("etc/ramfb", &fb_selector, 0x0);
+}
+
+// Los harts secundarios arrancan con sstatus.VS apagado
+void fb_init_hart(void) {
+	if (fb_has_rvv) {
+		fb_probe_rvv();
 	}
-	count = bswap4(count);
-	for (int i = 0; i < count; i++) {
-		if (fw_cfg_dma_read(&file, sizeof(file))) {
-			continue;
-		}
-		if (str_eq("etc/ramfb", file.name)) {
-			fb_selector = bswap2(file.select);
-			break;
-		}
+}
+
+bool fb_set_mode(uint32_t width, uint32_t height, enum fb_format format) {
+	// Región reservada para el scanout en linker.ld, alineada a página y
+	// fuera de la imagen del kernel
+	extern uint8_t fb_scanout_start, fb_scanout_end;
+
+	uint32_t bpp = format == FB_FORMAT_RGB565 ? 2 : 4;
+	uint32_t fourcc = format == FB_FORMAT_RGB565 ? FB_PIXFMT_RGB565 : FB_PIXFMT_XRGB8888;
+	uint32_t stride = width * bpp;
+	uint64_t size = (uint64_t) stride * height;
+
+	if (fb_selector == 0 || width == 0 || height == 0) {
+		return true;
+	}
+	if (sizeof(fb_back_buffer) < size || (uint64_t) (&fb_scanout_end - &fb_scanout_start) < size) {
+		return true;
 	}
 
 	struct attr_packed {
@@ -43,12 +105,12 @@ bool fb_init(void* address, uint32_t width, uint32_t height) {
 		uint32_t height;
 		uint32_t stride;
 	} fb_config = {
-		.addr = bswap8((uint64_t) address),
-		.fourcc = bswap4(FB_PIXFMT_XRGB8888),
+		.addr = bswap8((uint64_t) &fb_scanout_start),
+		.fourcc = bswap4(fourcc),
 		.flags = bswap4(0),
 		.width = bswap4(width),
 		.height = bswap4(height),
-		.stride = bswap4(width * 4)
+		.stride = bswap4(stride)
 	};
 
 	if (fw_cfg_dma_write_to(fb_selector, &fb_config, sizeof(fb_config))) {
@@ -56,108 +118,745 @@ bool fb_init(void* address, uint32_t width, uint32_t height) {
 	}
 
 	fb = (struct fb_config) {
-		.canvas = address,
+		.font = fb.font,
+		.canvas = fb_back_buffer,
+		.scanout = &fb_scanout_start,
 		.width = width,
-		.height = height
+		.height = height,
+		.stride = stride,
+		.bpp = bpp,
+		.format = format
 	};
+	fb_damage_count = 0;
+	// El scanout ahora tiene otro formato, lo que había abajo no sirve
+	fb_cursor.drawn = false;
+
+	return false;
+}
+
+uint32_t fb_pixel(rgb_t col) {
+	if (fb.format == FB_FORMAT_RGB565) {
+		return (uint32_t) (col.R >> 3) << 11 | (uint32_t) (col.G >> 2) << 5 | col.B >> 3;
+	}
+	return (uint32_t) col.X << 24 | (uint32_t) col.R << 16 | (uint32_t) col.G << 8 | col.B;
+}
+
+static inline
+uint8_t* fb_canvas_at(uint32_t x, uint32_t y) {
+	return (uint8_t*) fb.canvas + (uint64_t) y * fb.stride + (uint64_t) x * fb.bpp;
+}
+
+void fb_fill_span_words(void* dst, uint32_t px, uint64_t count) {
+	uint32_t* dst32 = dst;
+
+	// Pixel suelto hasta quedar alineados a 8 bytes
+	if (count != 0 && ((uintptr_t) dst32 & 7) != 0) {
+		*dst32++ = px;
+		count--;
+	}
+
+	uint64_t pair = (uint64_t) px << 32 | px;
+	uint64_t* dst64 = (uint64_t*) dst32;
+	uint64_t pairs = count / 2;
+	while (4 <= pairs) {
+		dst64[0] = pair;
+		dst64[1] = pair;
+		dst64[2] = pair;
+		dst64[3] = pair;
+		dst64 += 4;
+		pairs -= 4;
+	}
+	while (pairs--) {
+		*dst64++ = pair;
+	}
+
+	// Pixel suelto al final si la cantidad era impar
+	if (count & 1) {
+		*(uint32_t*) dst64 = px;
+	}
+}
+
+void fb_fill_span16_words(void* dst, uint32_t px, uint64_t count) {
+	uint16_t* dst16 = dst;
+
+	while (count != 0 && ((uintptr_t) dst16 & 7) != 0) {
+		*dst16++ = px;
+		count--;
+	}
+
+	uint64_t quad = (uint64_t) (px & 0xFFFF) * 0x0001000100010001;
+	uint64_t* dst64 = (uint64_t*) dst16;
+	uint64_t quads = count / 4;
+	while (4 <= quads) {
+		dst64[0] = quad;
+		dst64[1] = quad;
+		dst64[2] = quad;
+		dst64[3] = quad;
+		dst64 += 4;
+		quads -= 4;
+	}
+	while (quads--) {
+		*dst64++ = quad;
+	}
+
+	dst16 = (uint16_t*) dst64;
+	for (count &= 3; count != 0; count--) {
+		*dst16++ = px;
+	}
+}
+
+static inline
+void fb_fill_span(void* dst, uint32_t px, uint64_t count) {
+	if (fb.bpp == 2) {
+		if (fb_has_rvv) {
+			fb_fill_span16_rvv(dst, px, count);
+		} else {
+			fb_fill_span16_words(dst, px, count);
+		}
+	} else if (fb_has_rvv) {
+		fb_fill_span_rvv(dst, px, count);
+	} else {
+		fb_fill_span_words(dst, px, count);
+	}
+}
+
+// Copia de a 8 bytes. Los tamaños y direcciones son múltiplos de 2 porque
+// ningún formato tiene pixels más chicos.
+void fb_copy_words(void* dst, const void* src, uint64_t bytes) {
+	uint16_t* dst16 = dst;
+	const uint16_t* src16 = src;
+
+	// Si no comparten alineación no queda otra que ir de a poco
+	if ((((uintptr_t) dst16 ^ (uintptr_t) src16) & 7) != 0) {
+		for (bytes /= 2; bytes != 0; bytes--) {
+			*dst16++ = *src16++;
+		}
+		return;
+	}
+
+	while (bytes != 0 && ((uintptr_t) dst16 & 7) != 0) {
+		*dst16++ = *src16++;
+		bytes -= 2;
+	}
+
+	uint64_t* dst64 = (uint64_t*) dst16;
+	const uint64_t* src64 = (const uint64_t*) src16;
+	uint64_t words = bytes / 8;
+	while (4 <= words) {
+		dst64[0] = src64[0];
+		dst64[1] = src64[1];
+		dst64[2] = src64[2];
+		dst64[3] = src64[3];
+		dst64 += 4;
+		src64 += 4;
+		words -= 4;
+	}
+	while (words--) {
+		*dst64++ = *src64++;
+	}
+
+	dst16 = (uint16_t*) dst64;
+	src16 = (const uint16_t*) src64;
+	for (bytes = (bytes & 7) / 2; bytes != 0; bytes--) {
+		*dst16++ = *src16++;
+	}
+}
+
+static inline
+void fb_copy(void* dst, const void* src, uint64_t bytes) {
+	if (fb_has_rvv) {
+		fb_copy_rvv(dst, src, bytes);
+	} else {
+		fb_copy_words(dst, src, bytes);
+	}
+}
+
+// Recibe rectángulos ya recortados y no vacíos
+static
+void fb_damage_locked(uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+	for (uint32_t i = 0; i < fb_damage_count; i++) {
+		struct fb_rect* r = &fb_damage_list[i];
+		if (r->x <= x && x + width <= r->x + r->width
+		 && r->y <= y && y + height <= r->y + r->height) {
+			return;
+		}
+	}
+
+	// Texto: glifos consecutivos en la misma fila extienden el último rect
+	if (fb_damage_count != 0) {
+		struct fb_rect* last = &fb_damage_list[fb_damage_count - 1];
+		if (last->y == y && last->height == height
+		 && x <= last->x + last->width && last->x <= x + width) {
+			uint32_t right = x + width < last->x + last->width
+				? last->x + last->width
+				: x + width;
+			if (x < last->x) last->x = x;
+			last->width = right - last->x;
+			return;
+		}
+	}
+
+	if (fb_damage_count == FB_MAX_DAMAGE) {
+		// Sin lugar: se colapsa todo en un único rect que lo contenga
+		uint32_t left = x, top = y, right = x + width, bottom = y + height;
+		for (uint32_t i = 0; i < fb_damage_count; i++) {
+			struct fb_rect* r = &fb_damage_list[i];
+			if (r->x < left) left = r->x;
+			if (r->y < top) top = r->y;
+			if (right < r->x + r->width) right = r->x + r->width;
+			if (bottom < r->y + r->height) bottom = r->y + r->height;
+		}
+		fb_damage_list[0] = (struct fb_rect) { left, top, right - left, bottom - top };
+		fb_damage_count = 1;
+		return;
+	}
+
+	fb_damage_list[fb_damage_count++] = (struct fb_rect) { x, y, width, height };
+}
+
+// Las tareas de sched.c dibujan desde varios harts a la vez
+void fb_damage(uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+	spin_lock(&fb_damage_lock);
+	fb_damage_locked(x, y, width, height);
+	spin_unlock(&fb_damage_lock);
+}
+
+// Flecha con la punta en (0, 0): '#' es el borde y '.' el relleno
+static const char fb_cursor_shape[FB_CURSOR_HEIGHT][FB_CURSOR_WIDTH + 1] = {
+	"#           ",
+	"##          ",
+	"#.#         ",
+	"#..#        ",
+	"#...#       ",
+	"#....#      ",
+	"#.....#     ",
+	"#......#    ",
+	"#.......#   ",
+	"#........#  ",
+	"#.........# ",
+	"#..........#",
+	"#......#####",
+	"#...#..#    ",
+	"#..# #..#   ",
+	"#.#  #..#   ",
+	"##    #..#  ",
+	"      #..#  ",
+	"       ##   ",
+};
+
+static inline
+uint8_t* fb_scanout_at(uint32_t x, uint32_t y) {
+	return (uint8_t*) fb.scanout + (uint64_t) y * fb.stride + (uint64_t) x * fb.bpp;
+}
+
+static
+void fb_cursor_restore(void) {
+	if (!fb_cursor.drawn) return;
+
+	const uint32_t* under = fb_cursor.under;
+	for (uint32_t i = 0; i < fb_cursor.height; i++) {
+		uint8_t* row = fb_scanout_at(fb_cursor.x, fb_cursor.y + i);
+		for (uint32_t j = 0; j < fb_cursor.width; j++) {
+			if (fb.bpp == 2) {
+				((uint16_t*) row)[j] = *under++;
+			} else {
+				((uint32_t*) row)[j] = *under++;
+			}
+		}
+	}
+	fb_cursor.drawn = false;
+}
+
+static
+void fb_cursor_draw(void) {
+	if (!fb_cursor.visible || fb.width <= fb_cursor.x || fb.height <= fb_cursor.y) return;
+
+	fb_cursor.width = fb.width - fb_cursor.x < FB_CURSOR_WIDTH ? fb.width - fb_cursor.x : FB_CURSOR_WIDTH;
+	fb_cursor.height = fb.height - fb_cursor.y < FB_CURSOR_HEIGHT ? fb.height - fb_cursor.y : FB_CURSOR_HEIGHT;
+
+	uint32_t border = fb_pixel((rgb_t) { 0 });
+	uint32_t fill = fb_pixel((rgb_t) { .R = 0xFF, .G = 0xFF, .B = 0xFF });
+	uint32_t* under = fb_cursor.under;
+	for (uint32_t i = 0; i < fb_cursor.height; i++) {
+		uint8_t* row = fb_scanout_at(fb_cursor.x, fb_cursor.y + i);
+		for (uint32_t j = 0; j < fb_cursor.width; j++) {
+			char c = fb_cursor_shape[i][j];
+			uint32_t px = c == '#' ? border : fill;
+			if (fb.bpp == 2) {
+				*under++ = ((uint16_t*) row)[j];
+				if (c != ' ') ((uint16_t*) row)[j] = px;
+			} else {
+				*under++ = ((uint32_t*) row)[j];
+				if (c != ' ') ((uint32_t*) row)[j] = px;
+			}
+		}
+	}
+	fb_cursor.drawn = true;
+}
+
+void fb_cursor_move(uint32_t x, uint32_t y) {
+	if (fb_cursor.drawn && fb_cursor.x == x && fb_cursor.y == y) return;
+
+	fb_cursor_restore();
+	fb_cursor.x = x;
+	fb_cursor.y = y;
+	fb_cursor_draw();
+}
+
+void fb_cursor_set_visible(bool visible) {
+	fb_cursor.visible = visible;
+	if (visible) {
+		if (!fb_cursor.drawn) fb_cursor_draw();
+	} else {
+		fb_cursor_restore();
+	}
+}
 
+// Si algún rect a presentar pisa al cursor hay que sacarlo antes de copiar,
+// sino `under` queda con pixels viejos
+static
+bool fb_cursor_damaged(void) {
+	if (!fb_cursor.drawn) return false;
+
+	for (uint32_t i = 0; i < fb_damage_count; i++) {
+		struct fb_rect* r = &fb_damage_list[i];
+		if (r->x < fb_cursor.x + fb_cursor.width && fb_cursor.x < r->x + r->width
+		 && r->y < fb_cursor.y + fb_cursor.height && fb_cursor.y < r->y + r->height) {
+			return true;
+		}
+	}
 	return false;
 }
 
+void fb_present(void) {
+	trace(TRACE_PRESENT_BEGIN, fb_damage_count, 0);
+	if (fb_cursor_damaged()) {
+		fb_cursor_restore();
+	}
+
+	for (uint32_t i = 0; i < fb_damage_count; i++) {
+		struct fb_rect* r = &fb_damage_list[i];
+		uint64_t offset = (uint64_t) r->y * fb.stride + (uint64_t) r->x * fb.bpp;
+		uint64_t row_bytes = (uint64_t) r->width * fb.bpp;
+
+		if (row_bytes == fb.stride) {
+			fb_copy((uint8_t*) fb.scanout + offset, (uint8_t*) fb.canvas + offset, row_bytes * r->height);
+			continue;
+		}
+
+		for (uint32_t y = 0; y < r->height; y++) {
+			fb_copy((uint8_t*) fb.scanout + offset, (uint8_t*) fb.canvas + offset, row_bytes);
+			offset += fb.stride;
+		}
+	}
+	fb_damage_count = 0;
+
+	if (!fb_cursor.drawn) {
+		fb_cursor_draw();
+	}
+	trace(TRACE_PRESENT_END, 0, 0);
+}
+
+void fb_scroll_region(uint32_t x, uint32_t y, uint32_t width, uint32_t height, int32_t dy) {
+	if (fb.width <= x || fb.height <= y) return;
+	if (fb.width - x < width) width = fb.width - x;
+	if (fb.height - y < height) height = fb.height - y;
+	if (width == 0 || height == 0) return;
+
+	fb_damage(x, y, width, height);
+
+	uint32_t distance = dy < 0 ? -dy : dy;
+	if (dy == 0 || height <= distance) return;
+	uint32_t rows = height - distance;
+	uint64_t row_bytes = (uint64_t) width * fb.bpp;
+
+	if (dy < 0) {
+		// Hacia arriba: se copia de arriba hacia abajo, el destino siempre
+		// queda antes que el origen así que pisar es seguro
+		uint8_t* dst = fb_canvas_at(x, y);
+		uint8_t* src = dst + (uint64_t) distance * fb.stride;
+		if (row_bytes == fb.stride) {
+			fb_copy(dst, src, row_bytes * rows);
+			return;
+		}
+		for (uint32_t i = 0; i < rows; i++) {
+			fb_copy(dst, src, row_bytes);
+			dst += fb.stride;
+			src += fb.stride;
+		}
+	} else {
+		// Hacia abajo: de a una fila empezando por la última
+		uint8_t* dst = fb_canvas_at(x, y + height - 1);
+		uint8_t* src = dst - (uint64_t) distance * fb.stride;
+		for (uint32_t i = 0; i < rows; i++) {
+			fb_copy(dst, src, row_bytes);
+			dst -= fb.stride;
+			src -= fb.stride;
+		}
+	}
+}
+
 void fb_clear(uint8_t r, uint8_t g, uint8_t b) {
 	rgb_t px = { .R = r, .G = g, .B = b };
-	for (int i = 0; i < fb.width * fb.height; i++) {
-		fb.canvas[i] = px;
+	fb_fill_rect(px, 0, 0, fb.width, fb.height);
+	fb_damage_list[0] = (struct fb_rect) { 0, 0, fb.width, fb.height };
+	fb_damage_count = 1;
+}
+
+static
+void fb_parallel_serial(uint32_t count, fb_band_fn fn, void* arg) {
+	for (uint32_t band = 0; band < count; band++) {
+		fn(arg, band);
+	}
+}
+
+void fb_set_parallel(fb_parallel_fn parallel, uint32_t bands) {
+	fb_parallel = parallel != 0x0 ? parallel : fb_parallel_serial;
+	fb_bands = bands != 0 ? bands : 1;
+}
+
+void fb_parallel_for(uint32_t count, fb_band_fn fn, void* arg) {
+	if (count <= 1) {
+		fb_parallel_serial(count, fn, arg);
+		return;
+	}
+	fb_parallel(count, fn, arg);
+}
+
+static
+void fb_fill_rows(uint8_t* row, uint32_t px, uint32_t width, uint32_t height) {
+	// Filas completas son contiguas en memoria, se llenan de una
+	if ((uint64_t) width * fb.bpp == fb.stride) {
+		fb_fill_span(row, px, (uint64_t) width * height);
+		return;
+	}
+
+	for (uint32_t i = 0; i < height; i++) {
+		fb_fill_span(row, px, width);
+		row += fb.stride;
 	}
 }
 
+// Un relleno repartido en `bands` franjas horizontales de igual alto
+struct fb_fill_job {
+	uint8_t* row;
+	uint32_t px;
+	uint32_t width;
+	uint32_t height;
+	uint32_t bands;
+};
+
+static
+void fb_fill_band(void* arg, uint32_t band) {
+	const struct fb_fill_job* job = arg;
+	uint32_t from = (uint64_t) job->height * band / job->bands;
+	uint32_t to = (uint64_t) job->height * (band + 1) / job->bands;
+	fb_fill_rows(job->row + (uint64_t) from * fb.stride, job->px, job->width, to - from);
+}
+
 void fb_fill_rect(rgb_t col, uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
-	for (int i = y; i < fb.height && i < y + height; i++) {
-		int row_offset = i * fb.width;
-		for (int j = x; j < fb.width && j < x + width; j++) {
-			fb.canvas[row_offset + j] = col;
-		}
+	if (fb.width <= x || fb.height <= y) return;
+	if (fb.width - x < width) width = fb.width - x;
+	if (fb.height - y < height) height = fb.height - y;
+	if (width == 0 || height == 0) return;
+
+	fb_damage(x, y, width, height);
+	uint32_t px = fb_pixel(col);
+	uint8_t* row = fb_canvas_at(x, y);
+
+	if (1 < fb_bands && fb_bands <= height && FB_BAND_MIN_PIXELS <= (uint64_t) width * height) {
+		struct fb_fill_job job = { row, px, width, height, fb_bands };
+		fb_parallel_for(fb_bands, fb_fill_band, &job);
+		return;
 	}
+	fb_fill_rows(row, px, width, height);
 }
 
 #if defined(FONT_monaco)
 #include "fonts/monaco.inc"
-#define font monaco
-#define FIRST_CHAR 32
-#define CHAR_WIDTH(c) 7
-#define CHAR_HEIGHT 16
-#define CHAR_SIZE 16
-#define LAST_CHAR (FIRST_CHAR + sizeof(font) / CHAR_SIZE)
+static const struct fb_font_desc fb_builtin_desc = {
+	.height = 16,
+	.first_char = 32,
+	.count = sizeof(monaco) / 16,
+	.columns = 1,
+	.fixed_width = 7,
+	.bitmap = monaco
+};
 #elif defined(FONT_cream12)
 #include "fonts/cream12.inc"
-#define font cream12
-#define FIRST_CHAR 32
-#define CHAR_WIDTH(c) cream12_width[c]
-#define CHAR_HEIGHT 16
-#define CHAR_SIZE 32
-#define LAST_CHAR (FIRST_CHAR + sizeof(font) / CHAR_SIZE)
+static const struct fb_font_desc fb_builtin_desc = {
+	.height = 16,
+	.first_char = 32,
+	.count = sizeof(cream12) / 32,
+	.columns = 2,
+	.widths = cream12_width + 32,
+	.bitmap = cream12
+};
 #else
 #error No supported font was defined!
 #endif
 
-void fb_print_char(char c, uint32_t start_x, uint32_t start_y) {
-	rgb_t px = { .R = 0, .G = 0, .B = 0 };
+#define FB_MAX_FONTS 4
+#define FB_FONT_FILE_MAX (sizeof(struct fb_font_file) + 256 + 256 * 2 * FB_FONT_MAX_HEIGHT)
+
+static struct fb_font fb_fonts[FB_MAX_FONTS];
+static uint32_t fb_font_count;
+
+// Acá llegan por DMA los archivos de fuentes y se leen sin copiarlos
+static uint8_t fb_font_file_buffer[FB_FONT_FILE_MAX];
+
+// Pre-rasteriza cada glifo a máscaras por fila. Los chars sin glifo usan el
+// de '?' (o quedan vacíos si la fuente tampoco tiene '?').
+static
+bool fb_font_build(struct fb_font* font, const struct fb_font_desc* desc) {
+	if (desc->height == 0 || FB_FONT_MAX_HEIGHT < desc->height) return true;
+	if (desc->columns == 0 || 2 < desc->columns) return true;
+
+	font->height = desc->height;
+	for (int c = 0; c < 256; c++) {
+		struct fb_glyph* g = &font->glyphs[c];
+		int src = c;
+		if (src < desc->first_char || desc->first_char + desc->count <= src) {
+			src = '?';
+		}
+
+		g->top = desc->height;
+		g->bottom = 0;
+		if (src < desc->first_char || desc->first_char + desc->count <= src) {
+			g->width = desc->fixed_width;
+			for (uint32_t y = 0; y < desc->height; y++) {
+				g->rows[y] = 0;
+			}
+			continue;
+		}
+
+		uint32_t index = src - desc->first_char;
+		// Índice al principio de la definición de este char.
+		const uint8_t* c_start = desc->bitmap + index * desc->columns * desc->height;
+
+		g->width = desc->widths != 0x0 ? desc->widths[index] : desc->fixed_width;
+		if (8 * desc->columns < g->width) {
+			g->width = 8 * desc->columns;
+		}
+		for (uint32_t y = 0; y < desc->height; y++) {
+			uint16_t mask = 0;
+			for (uint32_t x = 0; x < g->width; x++) {
+				// Para chars que ocupan más de 8 px de ancho.
+				// Offset del principio del char al bloque de 8px a usar.
+				uint32_t c_offset = desc->height * (x / 8);
+				if (c_start[c_offset + y] & (0x80 >> (x % 8))) {
+					mask |= 1 << x;
+				}
+			}
+			g->rows[y] = mask;
+			if (mask != 0) {
+				if (y < g->top) g->top = y;
+				g->bottom = y + 1;
+			}
+		}
+	}
+	return false;
+}
+
+const struct fb_font* fb_font_builtin(void) {
+	static bool built = false;
+	if (!built) {
+		fb_font_build(&fb_fonts[0], &fb_builtin_desc);
+		fb_font_count = 1;
+		built = true;
+	}
+	return &fb_fonts[0];
+}
+
+const struct fb_font* fb_font_load(const char* name) {
+	uint16_t selector;
+	uint32_t size;
+
+	fb_font_builtin();
+	if (fb_font_count == FB_MAX_FONTS) {
+		return 0x0;
+	}
+	if (fw_cfg_find_file(name, &selector, &size)) {
+		return 0x0;
+	}
+	if (size < sizeof(struct fb_font_file) || FB_FONT_FILE_MAX < size) {
+		return 0x0;
+	}
+	if (fw_cfg_dma_read_from(selector, fb_font_file_buffer, size)) {
+		return 0x0;
+	}
+
+	const struct fb_font_file* file = (const void*) fb_font_file_buffer;
+	if (!(file->magic[0] == 'M' && file->magic[1] == 'V' && file->magic[2] == 'F' && file->magic[3] == '1')) {
+		return 0x0;
+	}
+
+	uint32_t count = file->count;
+	uint64_t expected = sizeof(*file) + count + (uint64_t) count * file->columns * file->height;
+	if (size < expected) {
+		return 0x0;
+	}
+
+	struct fb_font_desc desc = {
+		.height = file->height,
+		.first_char = file->first_char,
+		.count = count,
+		.columns = file->columns,
+		.widths = file->data,
+		.bitmap = file->data + count
+	};
+	struct fb_font* font = &fb_fonts[fb_font_count];
+	if (fb_font_build(font, &desc)) {
+		return 0x0;
+	}
+	fb_font_count++;
+	return font;
+}
+
+void fb_set_font(const struct fb_font* font) {
+	fb.font = font;
+}
+
+// Área de recorte de un run de texto, ya intersectada con la pantalla y
+// expresada en filas del glifo [top, bottom) y columnas [left, right)
+struct fb_text_clip {
+	uint32_t top, bottom;
+	uint32_t left, right;
+};
+
+static
+bool fb_text_clip_init(struct fb_text_clip* out, const struct fb_rect* clip, uint32_t y) {
+	uint32_t left = 0, top = 0, right = fb.width, bottom = fb.height;
+	if (clip != 0x0) {
+		if (left < clip->x) left = clip->x;
+		if (top < clip->y) top = clip->y;
+		if (clip->x + clip->width < right) right = clip->x + clip->width;
+		if (clip->y + clip->height < bottom) bottom = clip->y + clip->height;
+	}
+	uint32_t height = fb.font->height;
+	if (right <= left || bottom <= y || y + height <= top) {
+		return false;
+	}
+
+	out->left = left;
+	out->right = right;
+	out->top = top <= y ? 0 : top - y;
+	out->bottom = y + height <= bottom ? height : bottom - y;
+	return out->top < out->bottom;
+}
+
+// Pinta las filas visibles del glifo en `x`, que tiene que tocar el área de
+// recorte. Si entra completo no se calcula ninguna máscara de recorte.
+static inline
+void fb_draw_glyph(const struct fb_glyph* g, uint32_t x, uint32_t y, const struct fb_text_clip* clip, uint32_t px) {
+	uint32_t clip_mask = 0xFFFF;
+	if (x < clip->left || clip->right < x + g->width) {
+		if (x < clip->left) clip_mask &= ~((1u << (clip->left - x)) - 1);
+		if (clip->right < x + g->width) clip_mask &= (1u << (clip->right - x)) - 1;
+	}
 
-	if (c < FIRST_CHAR || LAST_CHAR <= c) {
-		c = '?';
-	}
-
-	for (uint32_t y = 0; y < CHAR_HEIGHT; y++) {
-		for (uint32_t x = 0; x < CHAR_WIDTH(c); x++) {
-			// Índice al principio de la definición de este char.
-			int c_start = (c - FIRST_CHAR) * CHAR_SIZE;
-			// Para chars que ocupan más de 8 px de ancho.
-			// Offset del principio del char al bloque de 8px a usar.
-			int c_offset = CHAR_HEIGHT * (x / 8);
-			// Cuál offset x dentro de bloque de 8px actual.
-			int c_x = x % 8;
-			if (fb.width <= start_x + x) {
-				break;
+	uint32_t top = clip->top < g->top ? g->top : clip->top;
+	uint32_t bottom = g->bottom < clip->bottom ? g->bottom : clip->bottom;
+	uint8_t* row = fb_canvas_at(x, y + top);
+	if (fb.bpp == 2) {
+		for (uint32_t i = top; i < bottom; i++) {
+			uint32_t mask = g->rows[i] & clip_mask;
+			for (uint16_t* dst = (uint16_t*) row; mask != 0; dst++, mask >>= 1) {
+				if (mask & 1) {
+					*dst = px;
+				}
 			}
-			if (font[c_start + c_offset + y] & (0x80 >> c_x)) {
-				fb.canvas[(start_y + y) * fb.width + (start_x + x)] = px;
+			row += fb.stride;
+		}
+		return;
+	}
+
+	for (uint32_t i = top; i < bottom; i++) {
+		uint32_t mask = g->rows[i] & clip_mask;
+		for (uint32_t* dst = (uint32_t*) row; mask != 0; dst++, mask >>= 1) {
+			if (mask & 1) {
+				*dst = px;
 			}
 		}
-		if (fb.height <= start_y + y) {
-			break;
+		row += fb.stride;
+	}
+}
+
+uint32_t fb_draw_text_run(const char* str, uint64_t len, uint32_t x, uint32_t y, const struct fb_rect* clip, rgb_t color) {
+	struct fb_text_clip area;
+	if (!fb_text_clip_init(&area, clip, y)) {
+		return x + fb_measure_line_width(str, len);
+	}
+
+	uint32_t px = fb_pixel(color);
+	uint32_t damage_from = -1;
+	uint32_t damage_to = 0;
+	while (len-- && *str) {
+		const struct fb_glyph* g = &fb.font->glyphs[(uint8_t) *str++];
+		uint32_t gx = x;
+		x += g->width;
+		if (x <= area.left || area.right <= gx) {
+			continue;
+		}
+
+		fb_draw_glyph(g, gx, y, &area, px);
+		if (damage_from == -1) {
+			damage_from = gx < area.left ? area.left : gx;
 		}
+		damage_to = x < area.right ? x : area.right;
+	}
+
+	// Se marca el run entero así queda en un único rect
+	if (damage_from < damage_to) {
+		fb_damage(damage_from, y + area.top, damage_to - damage_from, area.bottom - area.top);
 	}
+	return x;
+}
+
+void fb_print_char(char c, uint32_t start_x, uint32_t start_y) {
+	rgb_t px = { .R = 0, .G = 0, .B = 0 };
+	const struct fb_glyph* g = &fb.font->glyphs[(uint8_t) c];
+	struct fb_text_clip area;
+
+	if (!fb_text_clip_init(&area, 0x0, start_y) || area.right <= start_x) {
+		return;
+	}
+
+	uint32_t right = start_x + g->width < area.right ? start_x + g->width : area.right;
+	fb_draw_glyph(g, start_x, start_y, &area, fb_pixel(px));
+	fb_damage(start_x, start_y + area.top, right - start_x, area.bottom - area.top);
 }
 
 uint32_t fb_measure_line_width(const char* str, uint64_t size) {
 	uint32_t res = 0;
 	while (*str && size--) {
-		res += CHAR_WIDTH(*str++);
+		res += fb.font->glyphs[(uint8_t) *str++].width;
 	}
 	return res;
 }
 
 uint32_t fb_measure_line_height(const char* s, uint64_t size) {
-	return CHAR_HEIGHT;
+	return fb.font->height;
 }
 
 uint32_t fb_measure_char(char c) {
-	return CHAR_WIDTH(c);
+	return fb.font->glyphs[(uint8_t) c].width;
 }
 
 void fb_print(const char* str, uint32_t start_x, uint32_t start_y) {
-	uint32_t x = start_x;
+	rgb_t px = { .R = 0, .G = 0, .B = 0 };
 	uint32_t y = start_y;
 	while (*str != 0) {
-		char c = *str;
-		if (c == '\n') {
-			y += CHAR_HEIGHT + 2;
-			x = start_x;
-		} else {
-			fb_print_char(c, x, y);
-			x += CHAR_WIDTH(c);
+		uint64_t len = 0;
+		while (str[len] != 0 && str[len] != '\n') {
+			len++;
+		}
+		fb_draw_text_run(str, len, start_x, y, 0x0, px);
+		str += len;
+		if (*str == '\n') {
+			y += fb.font->height + 2;
+			str++;
 		}
-		str++;
 	}
 }
 
@@ -166,25 +865,23 @@ void fb_print_charmap(uint32_t start_x, uint32_t start_y) {
 	uint32_t y = start_y;
 	for (int i = 0; i < 256; i++) {
 		if (i && i % 32 == 0) {
-			y += CHAR_HEIGHT + 2;
+			y += fb.font->height + 2;
 			x = start_x;
 		}
 		fb_print_char(i, x, y);
-		x += i < FIRST_CHAR || LAST_CHAR <= i
-			? CHAR_WIDTH('?')
-			: CHAR_WIDTH(i);
+		x += fb.font->glyphs[i].width;
 	}
 }
 
+void fb_printf(uint32_t start_x, uint32_t start_y, const char* fmt, ...) {
+	char str[256];
+	va_list args;
+	va_start(args, fmt);
+	kvsnprintf(str, sizeof(str), fmt, args);
+	va_end(args);
+	fb_print(str, start_x, start_y);
+}
+
 void fb_print_dec(uint32_t n, uint32_t start_x, uint32_t start_y) {
-	constexpr char lookup[] = "0123456789";
-	char str[33];
-	int i = sizeof(str) - 1;
-	str[i] = 0;
-	do {
-		i--;
-		str[i] = lookup[n%10];
-		n /= 10;
-	} while (n != 0 && 0 <= i);
-	fb_print(str + i, start_x, start_y);
+	fb_printf(start_x, start_y, "%u", n);
 }
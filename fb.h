@@ -7,21 +7,130 @@ typedef struct fb_rgb_pixel {
 	uint8_t B, G, R, X;
 } rgb_t;
 
+#define FB_FONT_MAX_HEIGHT 32
+
+// A font pre-rasterized to one mask per glyph row, bit i set means pixel
+// x = i is drawn. `top` and `bottom` bound the rows with any pixel set.
+struct fb_glyph {
+	uint16_t rows[FB_FONT_MAX_HEIGHT];
+	uint8_t width;
+	uint8_t top;
+	uint8_t bottom;
+};
+
+struct fb_font {
+	uint32_t height;
+	struct fb_glyph glyphs[256];
+};
+
+// Raw font bitmaps, `count` glyphs starting at `first_char`. Each glyph is
+// `columns` blocks of 8px wide by `height` rows, one byte per row and the
+// MSB is the leftmost pixel. Widths come from `widths` (one per glyph) or
+// `fixed_width` if it's NULL.
+struct fb_font_desc {
+	uint32_t height;
+	uint32_t first_char;
+	uint32_t count;
+	uint32_t columns;
+	uint32_t fixed_width;
+	const uint8_t* widths;
+	const uint8_t* bitmap;
+};
+
+// Font files loaded from fw_cfg: this header, `count` widths and then the
+// bitmaps laid out as in `struct fb_font_desc`. See utils/to_font_file.c.
+struct fb_font_file {
+	char magic[4]; // "MVF1"
+	uint8_t height;
+	uint8_t first_char;
+	uint8_t count;
+	uint8_t columns;
+	uint8_t data[];
+};
+
+enum fb_format {
+	FB_FORMAT_XRGB8888,
+	FB_FORMAT_RGB565,
+};
+
 struct fb_config {
-	struct fb_rgb_pixel* canvas;
+	// Font used by the text functions
+	const struct fb_font* font;
+	// Back buffer, every draw call writes here
+	void* canvas;
+	// Memory scanned out by the ramfb device, same layout as `canvas`
+	void* scanout;
 	uint32_t width;
 	uint32_t height;
+	// Bytes per row and per pixel
+	uint32_t stride;
+	uint32_t bpp;
+	enum fb_format format;
+};
+
+struct fb_rect {
+	uint32_t x, y, width, height;
 };
 
+// Runs fn(arg, band) for every band < count and returns once all of them
+// are done, so whatever was drawn is there for fb_present. The default one
+// is a plain loop on the calling hart.
+typedef void (*fb_band_fn)(void* arg, uint32_t band);
+typedef void (*fb_parallel_fn)(uint32_t count, fb_band_fn fn, void* arg);
+
 extern struct fb_config fb;
+extern bool fb_has_rvv;
+// Horizontal bands that large fills and redraws are split into
+extern uint32_t fb_bands;
 
-bool fb_init(void* address, uint32_t width, uint32_t height);
+bool fb_init(void);
+// Turns on the vector unit on a secondary hart if fb_init found one, every
+// hart may draw
+void fb_init_hart(void);
+// Large fills and scrollback redraws go through `parallel` in `bands`
+// bands, one per hart is a good pick
+void fb_set_parallel(fb_parallel_fn parallel, uint32_t bands);
+void fb_parallel_for(uint32_t count, fb_band_fn fn, void* arg);
+bool fb_set_mode(uint32_t width, uint32_t height, enum fb_format format);
+const struct fb_font* fb_font_builtin(void);
+// Loads a font file from fw_cfg, NULL if it's missing or malformed
+const struct fb_font* fb_font_load(const char* name);
+void fb_set_font(const struct fb_font* font);
+// Packs a colour in the current pixel format
+uint32_t fb_pixel(rgb_t col);
 void fb_clear(uint8_t r, uint8_t g, uint8_t b);
+void fb_damage(uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+void fb_present(void);
 uint32_t fb_measure_line_width(const char* str, uint64_t size);
 uint32_t fb_measure_line_height(const char* str, uint64_t size);
 uint32_t fb_measure_char(char c);
 void fb_print(const char* str, uint32_t start_x, uint32_t start_y);
 void fb_print_char(char c, uint32_t start_x, uint32_t start_y);
+// Draws up to `len` chars (stopping at a NUL) clipped to `clip` (the whole
+// screen if NULL). Returns the x where the next char would go.
+uint32_t fb_draw_text_run(const char* str, uint64_t len, uint32_t x, uint32_t y, const struct fb_rect* clip, rgb_t color);
 void fb_print_charmap(uint32_t start_x, uint32_t start_y);
 void fb_print_dec(uint32_t n, uint32_t start_x, uint32_t start_y);
-void fb_fill_rect(rgb_t col, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
\ No newline at end of file
+// fb_print with a kprintf format, up to 255 chars
+[[gnu::format(printf, 3, 4)]]
+void fb_printf(uint32_t start_x, uint32_t start_y, const char* fmt, ...);
+void fb_fill_rect(rgb_t col, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+// Moves the region contents `dy` pixels down (up if negative). The exposed
+// strip keeps its old pixels and must be repainted by the caller.
+void fb_scroll_region(uint32_t x, uint32_t y, uint32_t width, uint32_t height, int32_t dy);
+
+// Pointer sprite, drawn straight on the scanout over whatever fb_present
+// shows. Moving it only touches the pixels under the old and new positions.
+void fb_cursor_move(uint32_t x, uint32_t y);
+void fb_cursor_set_visible(bool visible);
+
+// Span kernels behind the fill and present paths. Fills take a packed
+// pixel and a pixel count, copies take a byte count.
+void fb_fill_span_words(void* dst, uint32_t px, uint64_t count);
+void fb_fill_span_rvv(void* dst, uint32_t px, uint64_t count);
+void fb_fill_span16_words(void* dst, uint32_t px, uint64_t count);
+void fb_fill_span16_rvv(void* dst, uint32_t px, uint64_t count);
+void fb_copy_words(void* dst, const void* src, uint64_t bytes);
+void fb_copy_rvv(void* dst, const void* src, uint64_t bytes);
+
+void fb_bench(void);
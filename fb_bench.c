@@ -0,0 +1,106 @@
+#include <stdint.h>
+
+#include "encoding.h"
+#include "fb.h"
+#include "kprintf.h"
+
+#define BENCH_ROUNDS 8
+
+// La versión original de fb_fill_rect, un pixel por iteración
+static
+void fill_rect_reference(rgb_t col, uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+	uint32_t px = fb_pixel(col);
+	for (int i = y; i < fb.height && i < y + height; i++) {
+		uint8_t* row = (uint8_t*) fb.canvas + i * fb.stride;
+		for (int j = x; j < fb.width && j < x + width; j++) {
+			if (fb.bpp == 2) {
+				((uint16_t*) row)[j] = px;
+			} else {
+				((uint32_t*) row)[j] = px;
+			}
+		}
+	}
+}
+
+static
+void fill_rect_words(rgb_t col, uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+	uint32_t px = fb_pixel(col);
+	uint8_t* row = (uint8_t*) fb.canvas + y * fb.stride + x * fb.bpp;
+	for (uint32_t i = 0; i < height; i++) {
+		if (fb.bpp == 2) {
+			fb_fill_span16_words(row, px, width);
+		} else {
+			fb_fill_span_words(row, px, width);
+		}
+		row += fb.stride;
+	}
+}
+
+static
+void fill_rect_rvv(rgb_t col, uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+	uint32_t px = fb_pixel(col);
+	uint8_t* row = (uint8_t*) fb.canvas + y * fb.stride + x * fb.bpp;
+	for (uint32_t i = 0; i < height; i++) {
+		if (fb.bpp == 2) {
+			fb_fill_span16_rvv(row, px, width);
+		} else {
+			fb_fill_span_rvv(row, px, width);
+		}
+		row += fb.stride;
+	}
+}
+
+typedef void (*fill_fn)(rgb_t col, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+
+static
+uint64_t bench_fill(fill_fn fill, uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+	rgb_t col = { .R = 69, .G = 170, .B = 69 };
+	uint64_t start = rdcycle();
+	for (int i = 0; i < BENCH_ROUNDS; i++) {
+		fill(col, x, y, width, height);
+	}
+	return (rdcycle() - start) / BENCH_ROUNDS;
+}
+
+static
+void bench_format(void) {
+	// x impar para que las filas arranquen desalineadas a 8 bytes
+	static const struct { uint32_t x, y, width, height; } sizes[] = {
+		{ 1,   1,   7,   16  }, // Una celda de texto
+		{ 33,  20,  64,  64  },
+		{ 0,   0,   320, 240 },
+		{ 0,   0,   640, 480 }, // Pantalla completa
+	};
+
+	kprintf("fb_bench: %s, cycles per fill (reference / words / rvv)\n", fb.format == FB_FORMAT_RGB565 ? "RGB565" : "XRGB8888");
+	for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		uint32_t x = sizes[i].x;
+		uint32_t y = sizes[i].y;
+		uint32_t w = sizes[i].width;
+		uint32_t h = sizes[i].height;
+		if (fb.width < x + w || fb.height < y + h) continue;
+
+		uint64_t reference = bench_fill(fill_rect_reference, x, y, w, h);
+		uint64_t words = bench_fill(fill_rect_words, x, y, w, h);
+		if (fb_has_rvv) {
+			uint64_t rvv = bench_fill(fill_rect_rvv, x, y, w, h);
+			kprintf("  %ux%u: %lu / %lu / %lu\n", w, h, reference, words, rvv);
+		} else {
+			kprintf("  %ux%u: %lu / %lu / n/a\n", w, h, reference, words);
+		}
+	}
+}
+
+void fb_bench(void) {
+	uint32_t width = fb.width;
+	uint32_t height = fb.height;
+	enum fb_format format = fb.format;
+
+	if (!fb_set_mode(width, height, FB_FORMAT_XRGB8888)) {
+		bench_format();
+	}
+	if (!fb_set_mode(width, height, FB_FORMAT_RGB565)) {
+		bench_format();
+	}
+	fb_set_mode(width, height, format);
+}
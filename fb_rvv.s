@@ -0,0 +1,63 @@
+.section .text, "ax"
+
+# void fb_fill_span_rvv(void* dst, uint32_t px, uint64_t count)
+#
+# Stores `count` copies of `px` starting at `dst`. Interrupts are masked while
+# the vector registers are live because the trap handler does not save them.
+.global fb_fill_span_rvv
+fb_fill_span_rvv:
+    beqz a2, 2f
+    csrrci t2, sstatus, 2
+    andi t2, t2, 2
+    vsetvli t0, a2, e32, m8, ta, ma
+    vmv.v.x v8, a1
+1:
+    vsetvli t0, a2, e32, m8, ta, ma
+    vse32.v v8, (a0)
+    sub a2, a2, t0
+    slli t1, t0, 2
+    add a0, a0, t1
+    bnez a2, 1b
+    csrs sstatus, t2
+2:
+    ret
+
+# void fb_fill_span16_rvv(void* dst, uint32_t px, uint64_t count)
+#
+# Same as fb_fill_span_rvv for 16 bit pixels.
+.global fb_fill_span16_rvv
+fb_fill_span16_rvv:
+    beqz a2, 2f
+    csrrci t2, sstatus, 2
+    andi t2, t2, 2
+    vsetvli t0, a2, e16, m8, ta, ma
+    vmv.v.x v8, a1
+1:
+    vsetvli t0, a2, e16, m8, ta, ma
+    vse16.v v8, (a0)
+    sub a2, a2, t0
+    slli t1, t0, 1
+    add a0, a0, t1
+    bnez a2, 1b
+    csrs sstatus, t2
+2:
+    ret
+
+# void fb_copy_rvv(void* dst, const void* src, uint64_t bytes)
+.global fb_copy_rvv
+fb_copy_rvv:
+    beqz a2, 2f
+    csrrci t2, sstatus, 2
+    andi t2, t2, 2
+1:
+    vsetvli t0, a2, e8, m8, ta, ma
+    vle8.v v8, (a1)
+    vse8.v v8, (a0)
+    sub a2, a2, t0
+    add a0, a0, t0
+    add a1, a1, t0
+    bnez a2, 1b
+    csrs sstatus, t2
+2:
+    ret
+    .end
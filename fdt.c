@@ -0,0 +1,97 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "utils.h"
+
+#include "fdt.h"
+
+#define FDT_BEGIN_NODE 1
+#define FDT_END_NODE   2
+#define FDT_PROP       3
+#define FDT_NOP        4
+#define FDT_END        9
+
+struct fdt_header {
+	uint32_t magic;
+	uint32_t totalsize;
+	uint32_t off_dt_struct;
+	uint32_t off_dt_strings;
+	uint32_t off_mem_rsvmap;
+	uint32_t version;
+	uint32_t last_comp_version;
+	uint32_t boot_cpuid_phys;
+	uint32_t size_dt_strings;
+	uint32_t size_dt_struct;
+};
+
+uint32_t fdt_u32(const void* value) {
+	return bswap4(*(const uint32_t*) value);
+}
+
+uint64_t fdt_cells(const void* value, uint32_t cells) {
+	const uint32_t* cell = value;
+	if (cells == 2) {
+		return (uint64_t) bswap4(cell[0]) << 32 | bswap4(cell[1]);
+	}
+	return bswap4(cell[0]);
+}
+
+bool fdt_has_string(const void* value, uint32_t len, const char* str) {
+	const char* s = value;
+	const char* end = s + len;
+	while (s < end) {
+		if (str_eq(s, str)) {
+			return true;
+		}
+		while (s < end && *s) s++;
+		s++;
+	}
+	return false;
+}
+
+static
+uint32_t fdt_align(uint32_t offset) {
+	return (offset + 3) & ~3;
+}
+
+bool fdt_walk(const void* fdt, const struct fdt_walker* walker, void* ctx) {
+	const struct fdt_header* header = fdt;
+	if (fdt == 0x0 || bswap4(header->magic) != FDT_MAGIC) {
+		return false;
+	}
+
+	const uint8_t* structs = (const uint8_t*) fdt + bswap4(header->off_dt_struct);
+	const char* strings = (const char*) fdt + bswap4(header->off_dt_strings);
+	uint32_t size = bswap4(header->size_dt_struct);
+	uint32_t offset = 0;
+	// Empieza en -1 para que el nodo raíz quede en 0
+	int32_t depth = -1;
+
+	while (offset < size) {
+		uint32_t token = fdt_u32(structs + offset);
+		offset += 4;
+		if (token == FDT_BEGIN_NODE) {
+			const char* name = (const char*) structs + offset;
+			uint32_t len = 0;
+			while (name[len]) len++;
+			offset = fdt_align(offset + len + 1);
+			depth++;
+			if (walker->begin_node) walker->begin_node(ctx, depth, name);
+		} else if (token == FDT_END_NODE) {
+			if (walker->end_node) walker->end_node(ctx, depth);
+			depth--;
+		} else if (token == FDT_PROP) {
+			uint32_t len = fdt_u32(structs + offset);
+			uint32_t name = fdt_u32(structs + offset + 4);
+			const void* value = structs + offset + 8;
+			offset = fdt_align(offset + 8 + len);
+			if (walker->prop) walker->prop(ctx, depth, strings + name, value, len);
+		} else if (token == FDT_NOP) {
+			continue;
+		} else {
+			// FDT_END o algo roto
+			break;
+		}
+	}
+	return true;
+}
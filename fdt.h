@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Flattened device tree, as OpenSBI hands it over in a1
+// https://devicetree-specification.readthedocs.io/en/stable/flattened-format.html
+#define FDT_MAGIC 0xD00DFEED
+
+// Callbacks for fdt_walk, any of them can be null. `depth` is 0 for the root
+// node and its properties.
+struct fdt_walker {
+	void (*begin_node)(void* ctx, uint32_t depth, const char* name);
+	void (*prop)(void* ctx, uint32_t depth, const char* name, const void* value, uint32_t len);
+	void (*end_node)(void* ctx, uint32_t depth);
+};
+
+// Visits every node and property in order. Returns false if the blob isn't
+// a device tree.
+bool fdt_walk(const void* fdt, const struct fdt_walker* walker, void* ctx);
+
+// Cells are big endian and only 4 byte aligned
+uint32_t fdt_u32(const void* value);
+// Reads a 1 or 2 cell number
+uint64_t fdt_cells(const void* value, uint32_t cells);
+// Whether a string list property (like compatible) contains `str`
+bool fdt_has_string(const void* value, uint32_t len, const char* str);
@@ -0,0 +1,54 @@
+#include <stdint.h>
+
+#include "kprintf.h"
+
+#include "histogram.h"
+
+// Sin __builtin_clzl: sin Zbb termina en __clzdi2 y no linkeamos libgcc
+static
+uint32_t histogram_bucket(uint64_t value) {
+	uint32_t bucket = 0;
+	while (value != 0) {
+		value >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+void histogram_add(struct histogram* h, uint64_t value) {
+	if (h->count == 0 || value < h->min) h->min = value;
+	if (h->max < value) h->max = value;
+	h->count++;
+	h->sum += value;
+	h->bucket[histogram_bucket(value)]++;
+}
+
+uint64_t histogram_percentile(const struct histogram* h, uint32_t percent) {
+	if (h->count == 0) return 0;
+
+	// El valor número `rank` (desde 1) en orden
+	uint64_t rank = (h->count * percent + 99) / 100;
+	if (rank == 0) rank = 1;
+	uint64_t seen = 0;
+	for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		seen += h->bucket[i];
+		if (rank <= seen) {
+			uint64_t upper = i == 0 ? 0 : i == 64 ? UINT64_MAX : (1ull << i) - 1;
+			return upper < h->max ? upper : h->max;
+		}
+	}
+	return h->max;
+}
+
+void histogram_print(const char* name, const struct histogram* h) {
+	if (h->count == 0) {
+		kprintf("    %-6s empty\n", name);
+		return;
+	}
+	kprintf(
+		"    %-6s n %lu  min %lu  avg %lu  p50 %lu  p90 %lu  p99 %lu  max %lu\n",
+		name, h->count, h->min, h->sum / h->count,
+		histogram_percentile(h, 50), histogram_percentile(h, 90),
+		histogram_percentile(h, 99), h->max
+	);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+// log2 buckets: bucket 0 counts zeros and bucket i values in
+// [2^(i - 1), 2^i). Good enough for latencies, where only the order of
+// magnitude and the tail matter.
+#define HISTOGRAM_BUCKETS 65
+
+struct histogram {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint32_t bucket[HISTOGRAM_BUCKETS];
+};
+
+// Not atomic: each histogram must have a single writer (or be updated with
+// interrupts masked)
+void histogram_add(struct histogram* h, uint64_t value);
+// Upper bound of the bucket where `percent` of the values are reached,
+// clamped to the max seen
+uint64_t histogram_percentile(const struct histogram* h, uint32_t percent);
+// One line: count, min, avg, p50, p90, p99 and max
+void histogram_print(const char* name, const struct histogram* h);
@@ -0,0 +1,327 @@
+// Host build of fb.c and keyboard.c. Renders a few fixed scenes into an
+// in-memory framebuffer, checks them against golden image hashes and
+// reports how long the main rendering paths take.
+//
+// Usage: hostbench [--dump]
+//   --dump writes every scene as a .ppm to look at it
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fb.h"
+#include "keyboard.h"
+
+#define WIDTH 640
+#define HEIGHT 480
+
+/* Stand-ins for the kernel side of fb.c and keyboard.c */
+
+// The real ones come from linker.ld, the Makefile defines fb_scanout_end
+uint8_t fb_scanout_start[3 << 20] __attribute__((aligned(4096)));
+
+bool fw_cfg_find_file(const char* name, uint16_t* selector, uint32_t* size) {
+	if (strcmp(name, "etc/ramfb") == 0) {
+		*selector = 1;
+		if (size != NULL) *size = 28;
+		return false;
+	}
+	return true;
+}
+
+bool fw_cfg_dma_read_from(uint16_t selector_from, void* to_addr, uint32_t size) {
+	return true;
+}
+
+bool fw_cfg_dma_write_to(uint16_t selector_to, void* from_addr, uint32_t size) {
+	return false;
+}
+
+long console_write(const char* str, uint64_t len) {
+	return fwrite(str, 1, len, stdout) != len;
+}
+
+// fb_has_rvv is always false on the host
+void fb_fill_span_rvv(void* dst, uint32_t px, uint64_t count) { abort(); }
+void fb_fill_span16_rvv(void* dst, uint32_t px, uint64_t count) { abort(); }
+void fb_copy_rvv(void* dst, const void* src, uint64_t bytes) { abort(); }
+
+// No harts here: bands run one after the other, last first, so the golden
+// images also catch a band that depends on another one being drawn before
+static
+void host_parallel(uint32_t count, fb_band_fn fn, void* arg) {
+	for (uint32_t band = count; band-- != 0;) {
+		fn(arg, band);
+	}
+}
+
+/* Golden images */
+
+struct golden {
+	const char* name;
+	enum fb_format format;
+	uint64_t hash;
+};
+
+// Regenerate by running with a known good build and copying the printed
+// hashes. They depend on the built-in font.
+static const struct golden goldens[] = {
+#if defined(FONT_cream12)
+	{ "text",       FB_FORMAT_XRGB8888, 0xae86f38544f31b6d },
+	{ "text",       FB_FORMAT_RGB565,   0x92c55758f17b58df },
+	{ "scrollback", FB_FORMAT_XRGB8888, 0xb7b830d6d82310e5 },
+	{ "scrollback", FB_FORMAT_RGB565,   0x17651e0aded61465 },
+	{ "cursor",     FB_FORMAT_XRGB8888, 0x5193b1ca5c6807b1 },
+	{ "cursor",     FB_FORMAT_RGB565,   0x9ac190fec2ba5c23 },
+#elif defined(FONT_monaco)
+	{ "text",       FB_FORMAT_XRGB8888, 0x5a3afed50a36020d },
+	{ "text",       FB_FORMAT_RGB565,   0x096983dc65eea33f },
+	{ "scrollback", FB_FORMAT_XRGB8888, 0x71e310c3265835cd },
+	{ "scrollback", FB_FORMAT_RGB565,   0x1b13ce343e079b6f },
+	{ "cursor",     FB_FORMAT_XRGB8888, 0x8174bcb0617282a5 },
+	{ "cursor",     FB_FORMAT_RGB565,   0x3180c7b3bf1650fd },
+#endif
+};
+
+static bool dump_scenes = false;
+static int failures = 0;
+
+// FNV-1a over what's on screen, after presenting
+static
+uint64_t scanout_hash(void) {
+	uint64_t hash = 0xcbf29ce484222325;
+	const uint8_t* px = fb.scanout;
+	for (uint64_t i = 0; i < (uint64_t) fb.stride * fb.height; i++) {
+		hash = (hash ^ px[i]) * 0x100000001b3;
+	}
+	return hash;
+}
+
+static
+void dump_ppm(const char* name) {
+	char filename[64];
+	snprintf(filename, sizeof(filename), "%s-%s.ppm", name, fb.format == FB_FORMAT_RGB565 ? "rgb565" : "xrgb8888");
+	FILE* f = fopen(filename, "wb");
+	if (f == NULL) return;
+
+	fprintf(f, "P6\n%u %u\n255\n", fb.width, fb.height);
+	for (uint32_t y = 0; y < fb.height; y++) {
+		const uint8_t* row = (const uint8_t*) fb.scanout + (uint64_t) y * fb.stride;
+		for (uint32_t x = 0; x < fb.width; x++) {
+			uint8_t rgb[3];
+			if (fb.format == FB_FORMAT_RGB565) {
+				uint16_t px = ((const uint16_t*) row)[x];
+				rgb[0] = (px >> 11) << 3;
+				rgb[1] = ((px >> 5) & 0x3F) << 2;
+				rgb[2] = (px & 0x1F) << 3;
+			} else {
+				uint32_t px = ((const uint32_t*) row)[x];
+				rgb[0] = px >> 16;
+				rgb[1] = px >> 8;
+				rgb[2] = px;
+			}
+			fwrite(rgb, 1, 3, f);
+		}
+	}
+	fclose(f);
+	printf("  wrote %s\n", filename);
+}
+
+static
+void check_scene(const char* name) {
+	fb_present();
+	uint64_t hash = scanout_hash();
+	const char* format = fb.format == FB_FORMAT_RGB565 ? "RGB565" : "XRGB8888";
+
+	if (dump_scenes) {
+		dump_ppm(name);
+	}
+
+	for (size_t i = 0; i < sizeof(goldens) / sizeof(goldens[0]); i++) {
+		if (goldens[i].format != fb.format || strcmp(goldens[i].name, name) != 0) {
+			continue;
+		}
+		if (goldens[i].hash == hash) {
+			printf("  %-10s %-8s ok\n", name, format);
+		} else {
+			printf("  %-10s %-8s MISMATCH (got 0x%016lx)\n", name, format, (unsigned long) hash);
+			failures++;
+		}
+		return;
+	}
+	printf("  %-10s %-8s no golden (got 0x%016lx)\n", name, format, (unsigned long) hash);
+}
+
+/* Scenes */
+
+static
+void scene_text(void) {
+	fb_clear(170, 69, 69);
+	fb_print("Hola ~~Organizacion del Computador 2~~!\nHola Arquitectura y Organizacion del Computador!", 40, 40);
+	fb_print_charmap(100, 100);
+	fb_print_dec(1234567890, 40, 400);
+	check_scene("text");
+}
+
+static
+void scene_scrollback(void) {
+	static const char* lines[] = {
+		"Hola! Esto es una prueba :)",
+		"",
+		"We're no strangers to love / You know the rules and so do I (Do I)",
+		"A full commitment's what I'm thinking of / You wouldn't get this from any other guy",
+	};
+
+	for (int i = 0; i < 40; i++) {
+		for (const char* s = lines[i % 4]; *s; s++) {
+			scrollback_putchar(*s);
+		}
+		scrollback_new_line();
+	}
+	scrollback_invalidate();
+	scrollback_draw();
+
+	// Tipear, borrar y moverse un poco por la historia
+	keyboard_process_scancode(0x23); // h
+	keyboard_process_scancode(0x17); // i
+	keyboard_process_scancode(0x0e); // Backspace
+	keyboard_process_scancode(0x48); // Up
+	keyboard_process_scancode(0x48); // Up
+	keyboard_process_scancode(0x50); // Down
+	scrollback_draw();
+	check_scene("scrollback");
+}
+
+static
+void scene_cursor(void) {
+	fb_cursor_set_visible(true);
+	for (uint32_t i = 0; i < 50; i++) {
+		fb_cursor_move(100 + i * 3, 100 + i);
+	}
+	// Texto abajo del cursor y el cursor saliéndose de la pantalla
+	fb_print("cursor", 248, 150);
+	fb_present();
+	fb_cursor_move(fb.width - 5, 150);
+	check_scene("cursor");
+
+	// Escondido tiene que quedar lo mismo que en el canvas
+	fb_cursor_set_visible(false);
+	if (memcmp(fb.scanout, fb.canvas, (uint64_t) fb.stride * fb.height) != 0) {
+		printf("  cursor     left pixels behind after hiding\n");
+		failures++;
+	}
+}
+
+/* Timing */
+
+static
+uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static
+void bench(void) {
+	const char* text = "The quick brown fox jumps over the lazy dog 0123456789";
+	uint64_t len = strlen(text);
+	rgb_t black = { 0 };
+	const int rounds = 2000;
+	uint64_t start;
+
+	start = now_ns();
+	for (int i = 0; i < rounds; i++) {
+		fb_draw_text_run(text, len, 15, 15 + (i % 25) * 18, NULL, black);
+	}
+	printf("  %-24s %8.1f ns\n", "glyph (text run)", (double) (now_ns() - start) / (rounds * len));
+
+	start = now_ns();
+	for (int i = 0; i < rounds; i++) {
+		fb_print_char(text[i % len], 15 + (i % 80) * 7, 200);
+	}
+	printf("  %-24s %8.1f ns\n", "glyph (fb_print_char)", (double) (now_ns() - start) / rounds);
+
+	start = now_ns();
+	for (int i = 0; i < rounds / 10; i++) {
+		fb_clear(i, 69, 69);
+	}
+	printf("  %-24s %8.1f ns\n", "fb_clear", (double) (now_ns() - start) / (rounds / 10));
+
+	start = now_ns();
+	for (int i = 0; i < rounds / 10; i++) {
+		fb_present();
+		fb_clear(i, 69, 69);
+	}
+	printf("  %-24s %8.1f ns\n", "fb_clear + fb_present", (double) (now_ns() - start) / (rounds / 10));
+
+	start = now_ns();
+	for (int i = 0; i < rounds / 10; i++) {
+		scrollback_invalidate();
+		scrollback_draw();
+	}
+	printf("  %-24s %8.1f ns\n", "scrollback_draw (full)", (double) (now_ns() - start) / (rounds / 10));
+
+	start = now_ns();
+	for (int i = 0; i < rounds; i++) {
+		if (keyboard_process_scancode(i % 2 ? 0x0e : 0x1e)) { // 'a' y Backspace
+			scrollback_draw();
+			fb_present();
+		}
+	}
+	printf("  %-24s %8.1f ns\n", "keystroke (incremental)", (double) (now_ns() - start) / rounds);
+
+	start = now_ns();
+	for (int i = 0; i < rounds / 10; i++) {
+		scrollback_putchar('x');
+		scrollback_new_line();
+		scrollback_draw();
+		fb_present();
+	}
+	printf("  %-24s %8.1f ns\n", "new line (scroll)", (double) (now_ns() - start) / (rounds / 10));
+
+	fb_cursor_set_visible(true);
+	start = now_ns();
+	for (int i = 0; i < rounds; i++) {
+		fb_cursor_move(i % fb.width, (i * 7) % fb.height);
+	}
+	printf("  %-24s %8.1f ns\n", "cursor move", (double) (now_ns() - start) / rounds);
+	fb_cursor_set_visible(false);
+}
+
+int main(int argc, char* argv[]) {
+	if (argc == 2 && strcmp(argv[1], "--dump") == 0) {
+		dump_scenes = true;
+	}
+
+	if (fb_init()) {
+		fprintf(stderr, "fb_init failed\n");
+		return 1;
+	}
+
+	fb_set_parallel(host_parallel, 4);
+
+	static const enum fb_format formats[] = { FB_FORMAT_XRGB8888, FB_FORMAT_RGB565 };
+
+	printf("Golden images\n");
+	for (int i = 0; i < 2; i++) {
+		if (fb_set_mode(WIDTH, HEIGHT, formats[i])) {
+			fprintf(stderr, "fb_set_mode failed\n");
+			return 1;
+		}
+		scrollback_invalidate();
+		scene_text();
+		scene_scrollback();
+		scene_cursor();
+	}
+
+	for (int i = 0; i < 2; i++) {
+		fb_set_mode(WIDTH, HEIGHT, formats[i]);
+		scrollback_invalidate();
+		printf("Timings, %s\n", formats[i] == FB_FORMAT_RGB565 ? "RGB565" : "XRGB8888");
+		bench();
+	}
+
+	return failures != 0;
+}
@@ -0,0 +1,49 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "encoding.h"
+#include "smp.h"
+
+#include "idle.h"
+
+// Los contadores son de cada hart y están en su percpu. idle_last es hasta
+// dónde está todo contado: arranca en 0, lo que corrió desde que prendió
+// la máquina cuenta como busy.
+
+void idle_wait(bool (*pending)(void)) {
+	clear_csr(sstatus, SSTATUS_SIE);
+	if (pending()) {
+		set_csr(sstatus, SSTATUS_SIE);
+		return;
+	}
+
+	// wfi vuelve con cualquier interrupción habilitada en sie aunque SIE
+	// esté apagado. Al prender SIE entra el handler, que cuenta como busy.
+	struct percpu* cpu = this_cpu();
+	uint64_t sleep = rdtime();
+	asm volatile ("wfi");
+	uint64_t wake = rdtime();
+
+	cpu->idle_busy += sleep - cpu->idle_last;
+	cpu->idle_idle += wake - sleep;
+	cpu->idle_wakeups++;
+	cpu->idle_last = wake;
+	set_csr(sstatus, SSTATUS_SIE);
+}
+
+// De otro hart los números pueden estar a mitad de actualizar, para
+// mostrarlos alcanza
+struct idle_stats idle_stats(uint32_t hart) {
+	if (SMP_MAX_HARTS <= hart) return (struct idle_stats) {};
+	const struct percpu* cpu = &percpu[hart];
+	unsigned long sie = clear_csr(sstatus, SSTATUS_SIE) & SSTATUS_SIE;
+	// Lo que va desde el último despertar también es busy
+	uint64_t now = rdtime();
+	struct idle_stats stats = {
+		.busy = cpu->idle_busy + now - cpu->idle_last,
+		.idle = cpu->idle_idle,
+		.wakeups = cpu->idle_wakeups,
+	};
+	set_csr(sstatus, sie);
+	return stats;
+}
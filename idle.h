@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Busy and idle time, in `time` CSR ticks (see TIMER_FREQ). `cycle` is no
+// good for this: it stops or gets skewed while the hart sits in wfi.
+struct idle_stats {
+	uint64_t busy;
+	uint64_t idle;
+	// Times wfi returned
+	uint64_t wakeups;
+};
+
+// Sleeps in wfi until the next interrupt, unless `pending` says there's
+// something to do. `pending` runs with interrupts masked, so nothing that
+// an interrupt queues after the check can be missed: the interrupt stays
+// pending and wakes the wfi. The handler runs once this returns.
+void idle_wait(bool (*pending)(void));
+// Each hart counts its own time
+struct idle_stats idle_stats(uint32_t hart);
@@ -1,107 +1,288 @@
 #include "encoding.h"
+#include "histogram.h"
 #include "interrupts.h"
+#include "klog.h"
+#include "kprintf.h"
+#include "plic.h"
+#include "smp.h"
+#include "trace.h"
 #include "utils.h"
 
 #define MCAUSE_INT   0x8000000000000000
 #define MCAUSE_CAUSE 0x7FFFFFFFFFFFFFFF
 
-[[gnu::interrupt("supervisor")]]
-[[gnu::aligned(4)]]
-void handle_trap(void);
+// Entrada en trap.s, los stubs llaman a trap_* de acá abajo
+extern uint8_t trap_vector[];
+#define STVEC_VECTORED 1
 
-#define EXTERNAL_TABLE_SIZE 32
-handler_fn external_handler[EXTERNAL_TABLE_SIZE];
+// Todas las fuentes del PLIC tienen handler, pero las estadísticas (con dos
+// histogramas cada una) sólo las primeras: en virt nada pasa de la 95
+#define EXTERNAL_STATS_SIZE 128
+handler_fn external_handler[PLIC_SOURCES];
+// Hart al que va cada fuente
+static uint8_t external_affinity[PLIC_SOURCES];
+static struct interrupts_external_stats external_stats[EXTERNAL_STATS_SIZE];
+static uint64_t external_traps;
 
-void handle_external_irq();
+void handle_external_irq(uint64_t entry);
 
 #define ISR_TABLE_SIZE 32
-handler_fn isr_handler[ISR_TABLE_SIZE] = {
-	[EXTERNAL_IRQ] = handle_external_irq,
-};
+handler_fn isr_handler[ISR_TABLE_SIZE];
 
 #define EXCEPTION_TABLE_SIZE 32
 handler_fn exception_handler[EXCEPTION_TABLE_SIZE];
 
-static volatile void* const PLIC_BASE = (void*) 0xC000000;
+void interrupts_init(uint32_t hart, const void* fdt) {
+	plic_init(fdt);
+	for (uint32_t i = 0; i < PLIC_SOURCES; i++) {
+		external_affinity[i] = hart;
+	}
+}
 
 // https://cdn2.hubspot.net/hubfs/3020607/An%20Introduction%20to%20the%20RISC-V%20Architecture.pdf
 // https://five-embeddev.com/riscv-priv-isa-manual/Priv-v1.12/supervisor.html#supervisor-trap-vector-base-address-register-stvec
 void interrupts_enable() {
-	write_csr(stvec, (uintptr_t) &handle_trap);
+	write_csr(stvec, (uintptr_t) trap_vector | STVEC_VECTORED);
 	write_csr(sstatus, read_csr(sstatus) | SSTATUS_SIE);
-	write_csr(sie, 1 << EXTERNAL_IRQ /* SEIE */);
+	set_csr(sie, 1 << EXTERNAL_IRQ /* SEIE */);
+
+	int32_t context = plic_context(this_cpu()->hartid);
+	if (context >= 0) {
+		plic_set_threshold(context, 0);
+	}
+}
 
-	const uint32_t supervisor_context = 1;
-	volatile uint32_t* priority_threshold = PLIC_BASE + 0x200000 + 0x1000 * supervisor_context;
-	*priority_threshold = 0;
+void interrupts_local_enable(uint32_t irq, handler_fn handler) {
+	if (ISR_TABLE_SIZE <= irq) return; // Out of bounds!
+	isr_handler[irq] = handler;
+	set_csr(sie, 1 << irq);
 }
 
-bool interrupts_external_query(uint32_t context, uint32_t interrupt) {
-	uint32_t mask = 1 << interrupt;
-	volatile uint32_t* enabled_register = PLIC_BASE + 0x2000 + 0x80 * context + interrupt / 32;
-	return (*enabled_register & mask) == mask;
+void interrupts_local_disable(uint32_t irq) {
+	if (ISR_TABLE_SIZE <= irq) return; // Out of bounds!
+	clear_csr(sie, 1 << irq);
+	isr_handler[irq] = 0x0;
 }
 
-void interrupts_external_enable(uint32_t context, uint32_t interrupt, handler_fn handler) {
-	if (EXTERNAL_TABLE_SIZE <= interrupt) return; // Out of bounds!
-	uint32_t mask = 1 << interrupt;
-	volatile uint32_t* priority = PLIC_BASE + 0x4 * interrupt;
-	volatile uint32_t* enabled_register = PLIC_BASE + 0x2000 + 0x80 * context + interrupt / 32;
-	*enabled_register = *enabled_register | mask;
-	*priority = 1;
+void interrupts_exception_set(uint32_t cause, handler_fn handler) {
+	if (EXCEPTION_TABLE_SIZE <= cause) return; // Out of bounds!
+	exception_handler[cause] = handler;
+}
+
+bool interrupts_external_query(uint32_t hart, uint32_t interrupt) {
+	int32_t context = plic_context(hart);
+	return context >= 0 && plic_is_enabled(context, interrupt);
+}
+
+void interrupts_external_enable(uint32_t interrupt, handler_fn handler) {
+	if (plic_sources() <= interrupt) return; // Out of bounds!
+	int32_t context = plic_context(external_affinity[interrupt]);
+	if (context < 0) return;
 	external_handler[interrupt] = handler;
+	plic_set_priority(interrupt, 1);
+	plic_enable(context, interrupt);
 }
 
-void interrupts_external_disable(uint32_t context, uint32_t interrupt) {
-	if (EXTERNAL_TABLE_SIZE <= interrupt) return; // Out of bounds!
-	uint32_t mask = 1 << interrupt;
-	volatile uint32_t* priority = PLIC_BASE + 0x4 * interrupt;
-	volatile uint32_t* enabled_register = PLIC_BASE + 0x2000 + 0x80 * context + interrupt / 32;
-	*enabled_register = *enabled_register & ~mask;
-	*priority = 0;
+void interrupts_external_disable(uint32_t interrupt) {
+	if (plic_sources() <= interrupt) return; // Out of bounds!
+	int32_t context = plic_context(external_affinity[interrupt]);
+	if (context >= 0) {
+		plic_disable(context, interrupt);
+	}
+	plic_set_priority(interrupt, 0);
 	external_handler[interrupt] = 0x0;
 }
 
-uint32_t interrupts_claim(uint32_t context) {
-	volatile uint32_t* claim_register = PLIC_BASE + 0x200000 + 0x1000 * context + 0x4;
-	return *claim_register;
+void interrupts_external_set_priority(uint32_t interrupt, uint32_t priority) {
+	if (PLIC_MAX_PRIORITY < priority) priority = PLIC_MAX_PRIORITY;
+	plic_set_priority(interrupt, priority);
+}
+
+// Se prende en el contexto nuevo antes de apagarla en el viejo, así no hay
+// un momento en que no la atienda nadie
+bool interrupts_external_set_affinity(uint32_t interrupt, uint32_t hart) {
+	if (plic_sources() <= interrupt) return false;
+	int32_t context = plic_context(hart);
+	int32_t previous = plic_context(external_affinity[interrupt]);
+	if (context < 0) return false;
+
+	if (external_handler[interrupt]) {
+		plic_enable(context, interrupt);
+		if (previous >= 0 && previous != context) {
+			plic_disable(previous, interrupt);
+		}
+	}
+	external_affinity[interrupt] = hart;
+	return true;
+}
+
+// Se siguen reclamando fuentes hasta que el PLIC devuelve 0, así una ráfaga
+// (teclado y mouse juntos, los 3 bytes de un paquete del mouse) sale en un
+// solo trap. Lo que se atiende después del primero cuenta como coalescido.
+//
+// `entry` es el rdcycle del stub de entrada. Por fuente se miden los ciclos
+// de ahí al claim (wait) y del claim al complete (run).
+void handle_external_irq(uint64_t entry) {
+	uint32_t context = plic_context(this_cpu()->hartid);
+	uint32_t claim;
+	uint32_t handled = 0;
+	external_traps++;
+	while ((claim = plic_claim(context)) != 0) {
+		uint64_t claimed = rdcycle();
+		trace(TRACE_PLIC_CLAIM, claim, 0);
+		handler_fn handler = claim < PLIC_SOURCES ? external_handler[claim] : 0x0;
+		if (handler) {
+			handler();
+		} else {
+			klog(KLOG_WARN, "Ignoring unknown interrupt 0x%X", claim);
+		}
+		plic_complete(context, claim);
+		uint64_t completed = rdcycle();
+		trace(TRACE_PLIC_COMPLETE, claim, 0);
+
+		if (handler && claim < EXTERNAL_STATS_SIZE) {
+			struct interrupts_external_stats* stats = &external_stats[claim];
+			stats->handled++;
+			if (handled != 0) {
+				stats->coalesced++;
+			}
+			histogram_add(&stats->wait, claimed - entry);
+			histogram_add(&stats->run, completed - claimed);
+		}
+		handled++;
+	}
+}
+
+const struct interrupts_external_stats* interrupts_external_stats(uint32_t interrupt) {
+	if (EXTERNAL_STATS_SIZE <= interrupt) return 0x0;
+	return &external_stats[interrupt];
+}
+
+void interrupts_print_stats(void) {
+	kprintf("interrupts: %lu external traps\n", external_traps);
+	for (uint32_t i = 0; i < EXTERNAL_STATS_SIZE; i++) {
+		if (external_stats[i].handled == 0) continue;
+		kprintf(
+			"  irq %2u: %lu handled, %lu coalesced, cycles:\n",
+			i, external_stats[i].handled, external_stats[i].coalesced
+		);
+		histogram_print("wait", &external_stats[i].wait);
+		histogram_print("run", &external_stats[i].run);
+	}
 }
 
-void interrupts_complete(uint32_t context, uint32_t claim) {
-	volatile uint32_t* claim_register = PLIC_BASE + 0x200000 + 0x1000 * context + 0x4;
-	*claim_register = claim;
+void trap_exception(void) {
+	uint64_t id = read_csr(scause);
+	trace(TRACE_TRAP_ENTER, id, id);
+	if (id < EXCEPTION_TABLE_SIZE && exception_handler[id]) {
+		exception_handler[id]();
+	}
+	klog(KLOG_INFO, "Finished handling exception 0x%lX", id);
+	trace(TRACE_TRAP_EXIT, 0, 0);
 }
 
-void handle_external_irq() {
-	uint32_t claim = interrupts_claim(SUPERVISOR_CONTEXT);
-	if (claim < EXTERNAL_TABLE_SIZE && external_handler[claim]) {
-		external_handler[claim]();
+// Timer y software pueden no tener handler todavía, external siempre
+void trap_software(void) {
+	trace(TRACE_TRAP_ENTER, SOFTWARE_IRQ, MCAUSE_INT | SOFTWARE_IRQ);
+	handler_fn handler = isr_handler[SOFTWARE_IRQ];
+	if (handler) {
+		handler();
+	} else {
+		clear_csr(sip, SIP_SSIP);
+	}
+	trace(TRACE_TRAP_EXIT, 0, 0);
+}
 
-		//FIXME: Trace
-		//print("Finished handling ");
-		//print_hex(claim);
-		//print("\n");
+void trap_timer(void) {
+	trace(TRACE_TRAP_ENTER, TIMER_IRQ, MCAUSE_INT | TIMER_IRQ);
+	handler_fn handler = isr_handler[TIMER_IRQ];
+	if (handler) {
+		handler();
 	} else {
-		print("Ignoring unknown interrupt ");
-		print_hex(claim);
-		print("\n");
+		clear_csr(sie, 1 << TIMER_IRQ);
 	}
-	interrupts_complete(SUPERVISOR_CONTEXT, claim);
+	trace(TRACE_TRAP_EXIT, 0, 0);
 }
 
-void handle_trap() {
+void trap_external(uint64_t entry) {
+	trace(TRACE_TRAP_ENTER, EXTERNAL_IRQ, MCAUSE_INT | EXTERNAL_IRQ);
+	handle_external_irq(entry);
+	trace(TRACE_TRAP_EXIT, 0, 0);
+}
+
+// Una interrupción que no habilitamos: se apaga para que no vuelva
+void trap_spurious(void) {
+	uint64_t id = read_csr(scause) & MCAUSE_CAUSE;
+	if (id < ISR_TABLE_SIZE) {
+		clear_csr(sie, 1 << id);
+	}
+	klog(KLOG_WARN, "Disabled spurious interrupt 0x%lX", id);
+}
+
+#ifdef TRAP_BENCH
+// El handler de antes, en modo directo: guarda todo y despacha por tabla
+[[gnu::interrupt("supervisor")]]
+[[gnu::aligned(4)]]
+static
+void handle_trap(void) {
 	uint64_t scause = read_csr(scause);
 	uint64_t id = scause & MCAUSE_CAUSE;
 	if (scause & MCAUSE_INT) {
-		if (id < ISR_TABLE_SIZE && isr_handler[id]) {
+		if (id == EXTERNAL_IRQ) {
+			handle_external_irq(rdcycle());
+		} else if (id < ISR_TABLE_SIZE && isr_handler[id]) {
 			isr_handler[id]();
 		}
 	} else {
 		if (id < EXCEPTION_TABLE_SIZE && exception_handler[id]) {
 			exception_handler[id]();
 		}
-		print("Finished handling exception ");
-		print_hex(id);
-		print("\n");
 	}
 }
+
+#define TRAP_BENCH_ROUNDS 64
+
+static volatile uint64_t bench_raised;
+static uint64_t bench_total;
+static uint64_t bench_min;
+
+static
+void bench_software_irq(void) {
+	uint64_t cycles = rdcycle() - bench_raised;
+	clear_csr(sip, SIP_SSIP);
+	bench_total += cycles;
+	if (cycles < bench_min) {
+		bench_min = cycles;
+	}
+}
+
+// Ciclos desde que se levanta SSIP hasta que corre el handler, con el
+// vector dado en stvec
+static
+void bench_stvec(const char* name, uintptr_t vector) {
+	bench_total = 0;
+	bench_min = UINT64_MAX;
+	write_csr(stvec, vector);
+	for (int i = 0; i < TRAP_BENCH_ROUNDS; i++) {
+		bench_raised = rdcycle();
+		set_csr(sip, SIP_SSIP);
+		// Acá ya entró la interrupción
+	}
+	kprintf("  %-8s avg %4lu  min %4lu\n", name, bench_total / TRAP_BENCH_ROUNDS, bench_min);
+}
+
+void interrupts_bench(void) {
+	handler_fn software = isr_handler[SOFTWARE_IRQ];
+	bool enabled = read_csr(sie) & (1 << SOFTWARE_IRQ);
+	interrupts_local_enable(SOFTWARE_IRQ, bench_software_irq);
+
+	kprintf("interrupts_bench: cycles from raising SSIP to its handler\n");
+	bench_stvec("direct", (uintptr_t) &handle_trap);
+	bench_stvec("vectored", (uintptr_t) trap_vector | STVEC_VECTORED);
+
+	isr_handler[SOFTWARE_IRQ] = software;
+	if (!enabled) {
+		clear_csr(sie, 1 << SOFTWARE_IRQ);
+	}
+}
+#endif
@@ -3,6 +3,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "histogram.h"
+
 // Internal IRQ codes
 // https://five-embeddev.com/riscv-priv-isa-manual/Priv-v1.12/supervisor.html#supervisor-interrupt-registers-sip-and-sie
 #define SOFTWARE_IRQ 1
@@ -13,11 +15,43 @@
 #define KEYBOARD_IRQ 12
 #define MOUSE_IRQ 13
 
-#define SUPERVISOR_CONTEXT 1
-
 typedef void (*handler_fn)(void);
 
+struct interrupts_external_stats {
+	// Times the source's handler ran
+	uint64_t handled;
+	// Of those, how many were picked up by an external trap that had
+	// already handled another claim (and so cost no trap of their own)
+	uint64_t coalesced;
+	// Cycles from trap entry to the claim, and from the claim to the
+	// complete (the handler itself)
+	struct histogram wait;
+	struct histogram run;
+};
+
+// Finds the PLIC and each hart's context in the device tree, `hart` is the
+// one taking external interrupts. Every source starts routed to it.
+void interrupts_init(uint32_t hart, const void* fdt);
+// Per hart: installs the trap vector and opens this hart's PLIC context
 void interrupts_enable();
-bool interrupts_external_query(uint32_t context, uint32_t interrupt);
-void interrupts_external_enable(uint32_t context, uint32_t interrupt, handler_fn handler);
-void interrupts_external_disable(uint32_t context, uint32_t interrupt);
+// Timer and software interrupts (the IRQ codes above), straight from sie
+void interrupts_local_enable(uint32_t irq, handler_fn handler);
+void interrupts_local_disable(uint32_t irq);
+// The handler may step over the faulting instruction by moving sepc
+void interrupts_exception_set(uint32_t cause, handler_fn handler);
+// External (PLIC) sources, 1 to 1023. Enabling one sets its priority to 1
+// and routes it to its affinity hart.
+bool interrupts_external_query(uint32_t hart, uint32_t interrupt);
+void interrupts_external_enable(uint32_t interrupt, handler_fn handler);
+void interrupts_external_disable(uint32_t interrupt);
+// 1 (lowest) to PLIC_MAX_PRIORITY, 0 masks the source
+void interrupts_external_set_priority(uint32_t interrupt, uint32_t priority);
+// Steers a source to `hart`'s S-mode context, so a noisy device doesn't
+// interrupt everyone. False if the hart has no context.
+bool interrupts_external_set_affinity(uint32_t interrupt, uint32_t hart);
+// Null for sources out of range
+const struct interrupts_external_stats* interrupts_external_stats(uint32_t interrupt);
+// Prints the number of external traps and the per-source counters
+void interrupts_print_stats(void);
+// Compares the old direct-mode handler with the vectored entry (BENCH=1)
+void interrupts_bench(void);
@@ -1,25 +1,47 @@
 #include <stdint.h>
 
+#include "console.h"
 #include "encoding.h"
 #include "fb.h"
+#include "idle.h"
 #include "interrupts.h"
 #include "keyboard.h"
+#include "klog.h"
 #include "kmi.h"
+#include "kprintf.h"
 #include "qemu.h"
 #include "sbi.h"
+#include "sched.h"
+#include "smp.h"
+#include "timer.h"
+#include "trace.h"
+#include "uart.h"
 #include "utils.h"
+#include "workqueue.h"
+
+// Lo que piden los trabajos se dibuja una sola vez por tanda, en
+// run_deferred_work
+static bool scrollback_dirty;
+static bool present_pending;
+
+static
+void keyboard_work(uint64_t scancode) {
+	if (keyboard_process_scancode(scancode)) {
+		scrollback_dirty = true;
+	}
+}
 
 void handle_keyboard(void) {
 	// QEMU makes data immediately available
 	uint8_t data = keyboard->data;
 
 	if (data == 0xFA) {
-		print("Received ACK from keyboard\n");
+		klog(KLOG_INFO, "Received ACK from keyboard");
 		return;
 	}
 
-	keyboard_process_scancode(data);
-	//print("Received "); print_sdec(data); print(" from the keyboard\n");
+	work_queue(keyboard_work, data);
+	//klog(KLOG_DEBUG, "Received %u from the keyboard", data);
 }
 
 enum {
@@ -29,14 +51,18 @@ enum {
 } mouse_state = MOUSE_WAIT_BYTE0;
 uint8_t mouse_byte0;
 uint8_t mouse_byte1;
-uint8_t mouse_byte2;
 int32_t mouse_x;
 int32_t mouse_y;
 bool mouse_left;
 bool mouse_mid;
 bool mouse_right;
 
-void mouse_process_event(void) {
+// El paquete llega como byte0 | byte1 << 8 | byte2 << 16
+void mouse_process_event(uint64_t packet) {
+	uint8_t mouse_byte0 = packet;
+	uint8_t mouse_byte1 = packet >> 8;
+	uint8_t mouse_byte2 = packet >> 16;
+
 	bool left  = !!(mouse_byte0 & 1);
 	bool right = !!(mouse_byte0 & 2);
 	bool mid   = !!(mouse_byte0 & 4);
@@ -56,36 +82,34 @@ void mouse_process_event(void) {
 	if (mouse_y < 0)  mouse_y = 0;
 	if (fb.height <= mouse_y) mouse_y = fb.height - 1;
 
-	if (mouse_left  != left)  print(left  ? "Left button down\n"   : "Left button up\n");
-	if (mouse_mid   != mid)   print(mid   ? "Middle button down\n" : "Middle button up\n");
-	if (mouse_right != right) print(right ? "Right button down\n"  : "Right button up\n");
+	if (mouse_left  != left)  klog(KLOG_INFO, left  ? "Left button down"   : "Left button up");
+	if (mouse_mid   != mid)   klog(KLOG_INFO, mid   ? "Middle button down" : "Middle button up");
+	if (mouse_right != right) klog(KLOG_INFO, right ? "Right button down"  : "Right button up");
 	mouse_left = left;
 	mouse_right = right;
 	mouse_mid = mid;
 
 	if (mouse_left) {
-		int i = mouse_y * fb.width + mouse_x;
-		fb.canvas[i] = (rgb_t) { mouse_x, mouse_y, 0 };
+		fb_fill_rect((rgb_t) { mouse_x, mouse_y, 0 }, mouse_x, mouse_y, 1, 1);
+		present_pending = true;
 	}
-	//print_sdec(mouse_x); print(" "); print_sdec(mouse_y); print("\n");
+	fb_cursor_move(mouse_x, mouse_y);
+	//klog(KLOG_DEBUG, "%d %d", mouse_x, mouse_y);
 
 	// Log mouse events
-	//print_hex(mouse_byte0); print(" "); print_hex(mouse_byte1); print(" "); print_hex(mouse_byte2); print(" ");
-	//if (left)  print("L"); else print(" ");
-	//if (mid)   print("M"); else print(" ");
-	//if (right) print("R"); else print(" ");
-	//print("\n  X: ");
-	//print_sdec(x_offset);
-	//print("\n  Y: ");
-	//print_sdec(y_offset);
-	//print("\n");
+	//klog(
+	//	KLOG_DEBUG, "0x%X 0x%X 0x%X %c%c%c X: %d Y: %d",
+	//	mouse_byte0, mouse_byte1, mouse_byte2,
+	//	left ? 'L' : ' ', mid ? 'M' : ' ', right ? 'R' : ' ',
+	//	x_offset, y_offset
+	//);
 }
 
 void handle_mouse(void) {
 	// QEMU makes data immediately available
 	uint8_t data = mouse->data;
 	if (mouse_state == MOUSE_WAIT_BYTE0 && data == 0xFA) {
-		print("Received ACK from mouse\n");
+		klog(KLOG_INFO, "Received ACK from mouse");
 		return;
 	}
 
@@ -96,9 +120,8 @@ void handle_mouse(void) {
 		mouse_byte1 = data;
 		mouse_state = MOUSE_WAIT_BYTE2;
 	} else if (mouse_state == MOUSE_WAIT_BYTE2) {
-		mouse_byte2 = data;
 		mouse_state = MOUSE_WAIT_BYTE0;
-		mouse_process_event();
+		work_queue(mouse_process_event, mouse_byte0 | mouse_byte1 << 8 | (uint64_t) data << 16);
 	}
 }
 
@@ -111,20 +134,82 @@ void zero_bss() {
 	}
 }
 
+// Lee de la UART hasta el delimitador (que queda en dst). Devuelve 0 si lo
+// encontró y SBI_ERR_FAILED si dst se llenó antes.
 long read_until(char delimiter, char* dst, long dst_size, long* written_size) {
 	long written = 0;
-	while (written < dst_size) {
-		long c = sbi_console_getchar();
-		if (c < 0) {
-			return c;
+	bool found = false;
+	while (written < dst_size && !found) {
+		char c;
+		if (uart_read(&c, 1) == 0) {
+			continue;
 		}
 		dst[written++] = c;
-		if (written_size != 0x0) {
-			*written_size += 1;
+		found = c == delimiter;
+	}
+	if (written_size != 0x0) {
+		*written_size = written;
+	}
+	return found ? SBI_SUCCESS : SBI_ERR_FAILED;
+}
+
+void print_stats(void) {
+	interrupts_print_stats();
+	kprintf("work: %lu dropped\n", work_dropped());
+
+	uint64_t online = smp_online_mask();
+	for (uint32_t hart = 0; hart < SMP_MAX_HARTS; hart++) {
+		if (!(online & (1ull << hart))) continue;
+		struct idle_stats idle = idle_stats(hart);
+		uint64_t total = idle.busy + idle.idle;
+		kprintf(
+			"idle: hart %u %lu%% idle, %lu ms busy, %lu ms idle, %lu wakeups\n",
+			hart, total != 0 ? idle.idle * 100 / total : 0,
+			idle.busy / TIMER_MS(1), idle.idle / TIMER_MS(1), idle.wakeups
+		);
+	}
+}
+
+// Eco de lo que llega por la UART, con \r como fin de línea. Ctrl-T vuelca
+// la traza y Ctrl-P los contadores de interrupciones.
+void handle_serial_input(void) {
+	char buf[64];
+	uint64_t n = uart_read(buf, sizeof(buf));
+	for (uint64_t i = 0; i < n; i++) {
+		if (buf[i] == 0x14) {
+			trace_dump();
+		} else if (buf[i] == 0x10) {
+			print_stats();
+		} else if (buf[i] == '\r') {
+			uart_write("\r\n", 2);
+		} else {
+			uart_write(&buf[i], 1);
 		}
 	}
 }
 
+// Si esto da falso el loop principal se puede dormir
+static
+bool main_loop_pending(void) {
+	return work_pending() || klog_pending() || uart_rx_pending();
+}
+
+// Corre los bottom halves de los handlers y después redibuja lo que hayan
+// tocado, una vez por tanda
+void run_deferred_work(void) {
+	if (work_run() == 0) return;
+
+	if (scrollback_dirty) {
+		scrollback_draw();
+		present_pending = true;
+	}
+	if (present_pending) {
+		fb_present();
+	}
+	scrollback_dirty = false;
+	present_pending = false;
+}
+
 void scrollback_print_line(const char* s) {
 	while (*s) {
 		scrollback_putchar(*s++);
@@ -136,8 +221,12 @@ int b;
 int c = 123;
 const int a_start;
 const int b_start = 1;
-int main() {
+// OpenSBI nos deja el hartid en a0 y el device tree en a1, start.s no los
+// toca
+int main(unsigned long hartid, const void* fdt) {
 	zero_bss();
+	smp_init_boot(hartid);
+	console_init();
 
 	void test_enumerate();
 	test_enumerate();
@@ -149,8 +238,6 @@ int main() {
 	struct sbiret marchid = sbi_get_marchid();
 	struct sbiret mimpid = sbi_get_mimpid();
 
-	struct sbiret dbcn_support = sbi_probe_extension(0x4442434E);
-
 	char qemu[8] = {};
 	char qemu_cfg[9] = {};
 	fw_cfg_read_signature(qemu, qemu_cfg);
@@ -179,31 +266,52 @@ int main() {
 				print("No pude leer el file :(\n");
 				sbi_shutdown();
 			}
-			print("  - ");
-			print(file.name);
-			print(" (size = ");
-			print_hex(bswap4(file.size));
-			print(", select = ");
-			print_hex(bswap2(file.select));
-			print(")\n");
+			kprintf("  - %s (size = 0x%X, select = 0x%X)\n", file.name, bswap4(file.size), bswap2(file.select));
 		}
 	}
 
-	if (fb_init((void*) 0x80200000, 640, 480)) {
+	if (fb_init() || fb_set_mode(640, 480, FB_FORMAT_XRGB8888)) {
 		print("Hubo un problema inicializando la pantalla!\n");
 	}
 
+	const struct fb_font* font = fb_font_load("opt/marcelov/font");
+	if (font != 0x0) {
+		print("Usando la fuente de opt/marcelov/font\n");
+		fb_set_font(font);
+	}
+
+#ifdef FB_BENCH
+	fb_bench();
+#endif
+
+	// Los otros harts sólo necesitan saber su contexto del PLIC
+	interrupts_init(hartid, fdt);
+	uint32_t harts = smp_start_secondaries();
+	kprintf("Corriendo en %u harts\n", harts);
+	// Una franja de pantalla por hart
+	fb_set_parallel(task_parallel_for, harts);
+#ifdef SCHED_BENCH
+	sched_bench();
+#endif
+
 	fb_clear(170, 69, 69);
 	fb_print("Hola ~~Organizacion del Computador 2~~!\nHola Arquitectura y Organizacion del Computador!", 40, 40);
 	fb_print_charmap(100, 100);
+	fb_present();
+	fb_cursor_set_visible(true);
 
-	interrupts_external_enable(1, 12, handle_keyboard);
-	interrupts_external_enable(1, 13, handle_mouse);
+	interrupts_external_enable(KEYBOARD_IRQ, handle_keyboard);
+	interrupts_external_enable(MOUSE_IRQ, handle_mouse);
+	uart_init();
 
 	kmi_enable_keyboard();
 	kmi_enable_mouse();
 
 	interrupts_enable();
+	timer_init();
+#ifdef TRAP_BENCH
+	interrupts_bench();
+#endif
 
 	scrollback_print_line("Hola! Esto es una prueba :)");
 	scrollback_print_line("");
@@ -287,7 +395,15 @@ int main() {
 		" / Never gonna tell a lie and hurt you"
 	);
 	scrollback_draw();
-
-	while (1) asm volatile("");
+	fb_present();
+
+	// Lo que encolaron y loguearon los handlers se atiende desde acá, y
+	// cuando no queda nada se duerme hasta la próxima interrupción
+	while (1) {
+		run_deferred_work();
+		klog_flush();
+		handle_serial_input();
+		idle_wait(main_loop_pending);
+	}
 	return 0;
 }
@@ -3,6 +3,7 @@
 
 #include "keyboard.h"
 #include "fb.h"
+#include "trace.h"
 #include "utils.h"
 
 constexpr uint64_t TOGGLE_SHIFT_IDX = 1;
@@ -172,6 +173,24 @@ constexpr uint32_t margin_left= 15;
 constexpr uint32_t margin_right = 15;
 constexpr uint32_t margin_top = 15;
 constexpr uint32_t margin_bottom = 15;
+// Líneas sucias a partir de las cuales scrollback_draw reparte en franjas
+constexpr uint32_t SCROLLBACK_BAND_MIN_LINES = 8;
+
+static const rgb_t scrollback_background = { .R = 170, .G = 69, .B = 69 };
+static const rgb_t scrollback_foreground = { .R = 0, .G = 0, .B = 0 };
+
+// Estado de dibujado de cada línea, para redibujar sólo lo que cambió
+struct scrollback_line_state {
+	// Primera columna modificada desde el último dibujado (MAX_LINE_LEN si
+	// no cambió nada)
+	uint16_t dirty_from;
+	// Hasta qué x llegó la línea la última vez que se dibujó
+	uint16_t drawn_end;
+};
+static struct scrollback_line_state scrollbuffer_state[MAX_LINES_REMEMBERED];
+static bool scrollback_drawn = false;
+static uint32_t scrollback_drawn_top_line = 0;
+static uint32_t scrollback_drawn_rows = 0;
 
 static bool scrollbuffer_scrolls_on_new_line = false;
 static uint32_t scrollbuffer_top_line = 0;
@@ -180,6 +199,13 @@ static uint32_t curr_line = 0;
 static uint32_t curr_column = 0;
 static bool is_shift_pressed = false;
 
+static
+void scrollbuffer_mark_dirty(uint32_t line, uint32_t column) {
+	if (column < scrollbuffer_state[line].dirty_from) {
+		scrollbuffer_state[line].dirty_from = column;
+	}
+}
+
 static
 void scrollbuffer_scroll_down(void) {
 	if ((scrollbuffer_top_line + 1) % MAX_LINES_REMEMBERED == scrollbuffer_start) return;
@@ -207,6 +233,7 @@ void scrollback_new_line(void) {
 	for (int i = 0; i < MAX_LINE_LEN; i++) {
 		scrollbuffer[curr_line][i] = 0;
 	}
+	scrollbuffer_mark_dirty(curr_line, 0);
 }
 
 void scrollback_putchar(char c) {
@@ -214,6 +241,7 @@ void scrollback_putchar(char c) {
 	if (MAX_LINE_LEN <= curr_column) scrollback_new_line();
 	uint32_t line_width = margin_left + fb_measure_line_width(scrollbuffer[curr_line], curr_column) + fb_measure_char(c) + margin_right;
 	if (fb.width <= line_width) scrollback_new_line();
+	scrollbuffer_mark_dirty(curr_line, curr_column);
 	scrollbuffer[curr_line][curr_column++] = c;
 }
 
@@ -262,19 +290,100 @@ static
 bool delete_last(uint8_t scancode) {
 	if (curr_column == 0) return false;
 	scrollbuffer[curr_line][--curr_column] = 0;
+	scrollbuffer_mark_dirty(curr_line, curr_column);
 	return true;
 }
 
+// Redibuja la línea desde su primera columna modificada: borra lo que había
+// dibujado de ahí en adelante y rasteriza sólo los caracteres nuevos.
+static
+void scrollback_draw_line(uint32_t line, uint32_t y) {
+	struct scrollback_line_state* state = &scrollbuffer_state[line];
+	uint32_t column = state->dirty_from;
+	if (MAX_LINE_LEN <= column) return;
+
+	uint32_t x = margin_left + fb_measure_line_width(scrollbuffer[line], column);
+	if (x < state->drawn_end) {
+		uint32_t height = fb_measure_line_height(scrollbuffer[line], MAX_LINE_LEN);
+		fb_fill_rect(scrollback_background, x, y, state->drawn_end - x, height);
+	}
+
+	struct fb_rect clip = { margin_left, y, fb.width - margin_left - margin_right, fb.height - y };
+	x = fb_draw_text_run(scrollbuffer[line] + column, MAX_LINE_LEN - column, x, y, &clip, scrollback_foreground);
+	state->drawn_end = x < clip.x + clip.width ? x : clip.x + clip.width;
+	state->dirty_from = MAX_LINE_LEN;
+}
+
+// Filas visibles [0, rows) desde `top_line`, repartidas en `bands` franjas.
+// Cada línea toca sólo sus propias filas de pantalla y su propio estado, así
+// que las franjas se pueden dibujar en harts distintos.
+struct scrollback_job {
+	uint32_t top_line;
+	uint32_t rows;
+	uint32_t line_height;
+	uint32_t bands;
+};
+
+static
+void scrollback_draw_band(void* arg, uint32_t band) {
+	const struct scrollback_job* job = arg;
+	uint32_t from = job->rows * band / job->bands;
+	uint32_t to = job->rows * (band + 1) / job->bands;
+	for (uint32_t row = from; row < to; row++) {
+		uint32_t line = (job->top_line + row) % MAX_LINES_REMEMBERED;
+		scrollback_draw_line(line, margin_top + row * job->line_height);
+	}
+}
+
 void scrollback_draw(void) {
-	fb_clear(170, 69, 69);
+	trace(TRACE_SCROLLBACK_BEGIN, 0, 0);
+	uint32_t line_height = fb_measure_line_height(scrollbuffer[scrollbuffer_top_line], MAX_LINE_LEN);
+	uint32_t area_height = scrollback_drawn_rows * line_height;
+	bool full_redraw = !scrollback_drawn;
+	// Filas de pantalla [exposed_from, exposed_to) que quedan sin contenido,
+	// además de las que estén más allá de lo dibujado la última vez
+	uint32_t exposed_from = scrollback_drawn_rows;
+	uint32_t exposed_to = -1;
+
+	// Si la ventana visible se movió menos de una pantalla se corre lo que
+	// ya está dibujado y sólo se rasterizan las líneas nuevas
+	if (!full_redraw && scrollback_drawn_top_line != scrollbuffer_top_line) {
+		uint32_t down = (scrollbuffer_top_line + MAX_LINES_REMEMBERED - scrollback_drawn_top_line) % MAX_LINES_REMEMBERED;
+		uint32_t up = (scrollback_drawn_top_line + MAX_LINES_REMEMBERED - scrollbuffer_top_line) % MAX_LINES_REMEMBERED;
+
+		if (down < scrollback_drawn_rows) {
+			fb_scroll_region(0, margin_top, fb.width, area_height, -(int32_t) (down * line_height));
+			exposed_from = scrollback_drawn_rows - down;
+		} else if (up < scrollback_drawn_rows) {
+			fb_scroll_region(0, margin_top, fb.width, area_height, up * line_height);
+			exposed_from = 0;
+			exposed_to = up;
+		} else {
+			full_redraw = true;
+		}
+
+		if (!full_redraw) {
+			uint32_t strip_end = exposed_to < scrollback_drawn_rows ? exposed_to : scrollback_drawn_rows;
+			fb_fill_rect(
+				scrollback_background,
+				0, margin_top + exposed_from * line_height,
+				fb.width, (strip_end - exposed_from) * line_height
+			);
+		}
+	}
+
+	if (full_redraw) {
+		fb_fill_rect(scrollback_background, 0, 0, fb.width, fb.height);
+		exposed_from = 0;
+	}
 
-	uint32_t next_y;
 	uint32_t y = margin_top;
 	uint32_t line = scrollbuffer_top_line;
 	uint32_t last_line = -1;
+	uint32_t row = 0;
+	uint32_t dirty = 0;
 
 	while (1) {
-		uint32_t x = margin_left;
 		uint32_t next_y = y + fb_measure_line_height(scrollbuffer[line], MAX_LINE_LEN);
 
 		// If there's no vertical space available let's stop drawing here
@@ -283,17 +392,18 @@ void scrollback_draw(void) {
 		}
 
 		// Draw the current line
-		for (int i = 0; i < MAX_LINE_LEN && x + margin_right < fb.width; i++) {
-			char c = scrollbuffer[line][i];
-			if (c == 0) break;
-
-			fb_print_char(c, x, y);
-			x += fb_measure_char(c);
+		if ((exposed_from <= row && row < exposed_to) || scrollback_drawn_rows <= row) {
+			scrollbuffer_state[line].dirty_from = 0;
+			scrollbuffer_state[line].drawn_end = margin_left;
+		}
+		if (scrollbuffer_state[line].dirty_from < MAX_LINE_LEN) {
+			dirty++;
 		}
 		last_line = line; // Mark the last line drawn
 
 		// Advance
-		y += fb_measure_line_height(scrollbuffer[line], MAX_LINE_LEN);
+		y = next_y;
+		row++;
 		line = (line + 1) % MAX_LINES_REMEMBERED;
 
 		// Check if the next line is valid
@@ -302,15 +412,34 @@ void scrollback_draw(void) {
 		}
 	}
 
+	// Las líneas se dibujan recién ahora, ya sabiendo cuántas son. Con
+	// muchas sucias (redibujado completo, salto en la historia) cada franja
+	// va a un hart; una tecla sola se dibuja acá mismo.
+	struct scrollback_job job = { scrollbuffer_top_line, row, line_height, 1 };
+	if (SCROLLBACK_BAND_MIN_LINES <= dirty && fb_bands <= row) {
+		job.bands = fb_bands;
+	}
+	fb_parallel_for(job.bands, scrollback_draw_band, &job);
+
+	scrollback_drawn = true;
+	scrollback_drawn_top_line = scrollbuffer_top_line;
+	scrollback_drawn_rows = row;
+	trace(TRACE_SCROLLBACK_END, row, full_redraw);
+
 	// If the last line drawn is the current scrollbuffer line then re-enable the sticky bit
 	if (last_line == curr_line) {
 		scrollbuffer_scrolls_on_new_line = true;
 	}
 }
 
-void keyboard_process_scancode(uint8_t scancode) {
+void scrollback_invalidate(void) {
+	scrollback_drawn = false;
+}
+
+bool keyboard_process_scancode(uint8_t scancode) {
 	struct scancode_info info = scancode_defs[scancode];
 	bool should_redraw = true;
+	trace(TRACE_SCANCODE, scancode, 0);
 
 	if (info.main_value == '\0') {
 		should_redraw = special_scancodes[info.special_value](scancode);
@@ -318,7 +447,5 @@ void keyboard_process_scancode(uint8_t scancode) {
 		scrollback_putchar(is_shift_pressed ? info.special_value : info.main_value);
 	}
 
-	if (should_redraw) {
-		scrollback_draw();
-	}
+	return should_redraw;
 }
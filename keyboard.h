@@ -2,7 +2,12 @@
 
 #include <stdint.h>
 
-void keyboard_process_scancode(uint8_t scancode);
+// Only updates the scrollback, returns true if it has to be redrawn. Several
+// scancodes can share a single scrollback_draw.
+bool keyboard_process_scancode(uint8_t scancode);
 void scrollback_putchar(char c);
 void scrollback_new_line(void);
 void scrollback_draw();
+// Forces the next scrollback_draw to repaint everything (e.g. after a font
+// or mode change)
+void scrollback_invalidate(void);
@@ -0,0 +1,130 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "console.h"
+#include "kprintf.h"
+
+#include "klog.h"
+
+#define KLOG_SLOTS 64
+#define KLOG_TEXT 96
+#define KLOG_BATCH 512
+
+// `seq` es el índice del mensaje + 1 una vez escrito, 0 mientras se escribe.
+// Los productores reservan índices con un fetch_add y nunca esperan a
+// nadie. Si la cola se llena se pisan los más viejos y klog_flush cuenta
+// cuántos se perdieron.
+struct klog_entry {
+	uint64_t seq;
+	uint8_t level;
+	uint8_t len;
+	char text[KLOG_TEXT];
+};
+
+static struct klog_entry klog_ring[KLOG_SLOTS];
+static uint64_t klog_head;
+// Sólo lo toca klog_flush
+static uint64_t klog_tail;
+
+static const char* const klog_prefix[] = {
+	[KLOG_DEBUG] = "debug: ",
+	[KLOG_INFO] = "",
+	[KLOG_WARN] = "warn: ",
+	[KLOG_ERROR] = "error: ",
+};
+
+void klog_write(enum klog_level level, const char* fmt, ...) {
+	uint64_t index = __atomic_fetch_add(&klog_head, 1, __ATOMIC_RELAXED);
+	struct klog_entry* e = &klog_ring[index % KLOG_SLOTS];
+	__atomic_store_n(&e->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	va_list args;
+	va_start(args, fmt);
+	uint64_t len = kvsnprintf(e->text, KLOG_TEXT, fmt, args);
+	va_end(args);
+	if (KLOG_TEXT <= len) {
+		len = KLOG_TEXT - 1;
+	}
+	e->level = level;
+	e->len = len;
+
+	__atomic_store_n(&e->seq, index + 1, __ATOMIC_RELEASE);
+}
+
+static
+uint32_t klog_append(char* batch, uint32_t used, const char* str, uint32_t len) {
+	for (uint32_t i = 0; i < len && used < KLOG_BATCH; i++) {
+		batch[used++] = str[i];
+	}
+	return used;
+}
+
+static
+uint32_t klog_append_str(char* batch, uint32_t used, const char* str) {
+	while (*str && used < KLOG_BATCH) {
+		batch[used++] = *str++;
+	}
+	return used;
+}
+
+bool klog_pending(void) {
+	return __atomic_load_n(&klog_head, __ATOMIC_ACQUIRE) != klog_tail;
+}
+
+void klog_flush(void) {
+	char batch[KLOG_BATCH];
+	uint32_t used = 0;
+	uint64_t dropped = 0;
+
+	uint64_t head = __atomic_load_n(&klog_head, __ATOMIC_ACQUIRE);
+	while (klog_tail != head) {
+		if (KLOG_SLOTS < head - klog_tail) {
+			dropped += head - KLOG_SLOTS - klog_tail;
+			klog_tail = head - KLOG_SLOTS;
+		}
+
+		struct klog_entry* e = &klog_ring[klog_tail % KLOG_SLOTS];
+		uint64_t seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+		if (seq < klog_tail + 1) {
+			// Todavía lo están escribiendo, sigue en el próximo flush
+			break;
+		}
+		if (klog_tail + 1 < seq) {
+			dropped++;
+			klog_tail++;
+			continue;
+		}
+
+		// Que entre el mensaje entero con prefijo y newline
+		if (KLOG_BATCH - used < KLOG_TEXT + 16) {
+			console_write(batch, used);
+			used = 0;
+		}
+		uint32_t start = used;
+		used = klog_append_str(batch, used, klog_prefix[e->level]);
+		used = klog_append(batch, used, e->text, e->len);
+		used = klog_append(batch, used, "\n", 1);
+
+		// Si lo pisaron mientras lo copiábamos se descarta
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&e->seq, __ATOMIC_RELAXED) != seq) {
+			used = start;
+			dropped++;
+		}
+		klog_tail++;
+	}
+
+	if (dropped != 0) {
+		if (KLOG_BATCH - used < 48) {
+			console_write(batch, used);
+			used = 0;
+		}
+		used += ksnprintf(batch + used, KLOG_BATCH - used, "klog: %lu messages dropped\n", dropped);
+	}
+
+	if (used != 0) {
+		console_write(batch, used);
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum klog_level {
+	KLOG_DEBUG,
+	KLOG_INFO,
+	KLOG_WARN,
+	KLOG_ERROR,
+};
+
+// Messages below this level are compiled out (see LOG_LEVEL in the Makefile)
+#ifndef KLOG_LEVEL
+#define KLOG_LEVEL KLOG_INFO
+#endif
+
+// Safe from interrupt handlers: it only formats the message (see kprintf.h)
+// into a ring that klog_flush drains later. Each call is one line, the
+// newline is added.
+#define klog(level, ...) do { \
+	if (KLOG_LEVEL <= (level)) klog_write((level), __VA_ARGS__); \
+} while (0)
+
+[[gnu::format(printf, 2, 3)]]
+void klog_write(enum klog_level level, const char* fmt, ...);
+// Sends everything logged so far to the console. Only call it from one
+// place outside interrupt context (the idle loop).
+void klog_flush(void);
+// True if there's something for klog_flush to send
+bool klog_pending(void);
@@ -0,0 +1,199 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "console.h"
+
+#include "kprintf.h"
+
+#define KPRINTF_BUFFER 256
+
+struct kfmt_out {
+	char* buf;
+	uint64_t size;
+	uint64_t len;
+};
+
+// Cuenta todo lo que se emite aunque no entre, como snprintf
+static
+void kfmt_putc(struct kfmt_out* out, char c) {
+	if (out->len + 1 < out->size) {
+		out->buf[out->len] = c;
+	}
+	out->len++;
+}
+
+static
+void kfmt_pad(struct kfmt_out* out, char c, int32_t count) {
+	while (0 < count--) {
+		kfmt_putc(out, c);
+	}
+}
+
+struct kfmt_spec {
+	bool left;
+	bool zero;
+	bool alt;
+	int32_t width;
+	int32_t precision;
+};
+
+static
+void kfmt_string(struct kfmt_out* out, const struct kfmt_spec* spec, const char* s) {
+	if (s == 0x0) s = "(null)";
+
+	int32_t len = 0;
+	while (s[len] && (spec->precision < 0 || len < spec->precision)) {
+		len++;
+	}
+
+	if (!spec->left) kfmt_pad(out, ' ', spec->width - len);
+	for (int32_t i = 0; i < len; i++) {
+		kfmt_putc(out, s[i]);
+	}
+	if (spec->left) kfmt_pad(out, ' ', spec->width - len);
+}
+
+// `prefix` es el signo o el 0x, va antes del relleno con ceros
+static
+void kfmt_number(struct kfmt_out* out, const struct kfmt_spec* spec, uint64_t v, uint32_t base, bool upper, const char* prefix) {
+	const char* table = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+	char digits[20];
+	int32_t count = 0;
+	do {
+		digits[count++] = table[v % base];
+		v /= base;
+	} while (v != 0);
+
+	int32_t prefix_len = 0;
+	while (prefix[prefix_len]) prefix_len++;
+	int32_t padding = spec->width - count - prefix_len;
+
+	if (!spec->left && !spec->zero) kfmt_pad(out, ' ', padding);
+	for (int32_t i = 0; i < prefix_len; i++) {
+		kfmt_putc(out, prefix[i]);
+	}
+	if (!spec->left && spec->zero) kfmt_pad(out, '0', padding);
+	while (count) {
+		kfmt_putc(out, digits[--count]);
+	}
+	if (spec->left) kfmt_pad(out, ' ', padding);
+}
+
+uint64_t kvsnprintf(char* buf, uint64_t size, const char* fmt, va_list args) {
+	struct kfmt_out out = { buf, size, 0 };
+
+	while (*fmt) {
+		if (*fmt != '%') {
+			kfmt_putc(&out, *fmt++);
+			continue;
+		}
+		fmt++;
+
+		struct kfmt_spec spec = { .precision = -1 };
+		for (;; fmt++) {
+			if (*fmt == '-') spec.left = true;
+			else if (*fmt == '0') spec.zero = true;
+			else if (*fmt == '#') spec.alt = true;
+			else break;
+		}
+
+		if (*fmt == '*') {
+			spec.width = va_arg(args, int);
+			if (spec.width < 0) {
+				spec.left = true;
+				spec.width = -spec.width;
+			}
+			fmt++;
+		} else {
+			while ('0' <= *fmt && *fmt <= '9') {
+				spec.width = spec.width * 10 + (*fmt++ - '0');
+			}
+		}
+
+		if (*fmt == '.') {
+			fmt++;
+			spec.precision = 0;
+			if (*fmt == '*') {
+				spec.precision = va_arg(args, int);
+				fmt++;
+			} else {
+				while ('0' <= *fmt && *fmt <= '9') {
+					spec.precision = spec.precision * 10 + (*fmt++ - '0');
+				}
+			}
+		}
+
+		// En RV64 long, long long y size_t son todos de 64 bits
+		bool wide = false;
+		while (*fmt == 'l' || *fmt == 'z') {
+			wide = true;
+			fmt++;
+		}
+
+		switch (*fmt) {
+		case 'd':
+		case 'i': {
+			int64_t v = wide ? va_arg(args, int64_t) : va_arg(args, int);
+			uint64_t magnitude = v < 0 ? -(uint64_t) v : (uint64_t) v;
+			kfmt_number(&out, &spec, magnitude, 10, false, v < 0 ? "-" : "");
+			break;
+		}
+		case 'u':
+			kfmt_number(&out, &spec, wide ? va_arg(args, uint64_t) : va_arg(args, unsigned int), 10, false, "");
+			break;
+		case 'x':
+		case 'X': {
+			uint64_t v = wide ? va_arg(args, uint64_t) : va_arg(args, unsigned int);
+			const char* prefix = !spec.alt || v == 0 ? "" : *fmt == 'x' ? "0x" : "0X";
+			kfmt_number(&out, &spec, v, 16, *fmt == 'X', prefix);
+			break;
+		}
+		case 'p':
+			kfmt_number(&out, &spec, (uintptr_t) va_arg(args, void*), 16, false, "0x");
+			break;
+		case 'c':
+			kfmt_string(&out, &spec, (char[]) { va_arg(args, int), 0 });
+			break;
+		case 's':
+			kfmt_string(&out, &spec, va_arg(args, const char*));
+			break;
+		case '%':
+			kfmt_putc(&out, '%');
+			break;
+		default:
+			// Conversión desconocida: se deja tal cual
+			kfmt_putc(&out, '%');
+			if (*fmt == 0) continue;
+			kfmt_putc(&out, *fmt);
+			break;
+		}
+		fmt++;
+	}
+
+	if (size != 0) {
+		buf[out.len < size ? out.len : size - 1] = 0;
+	}
+	return out.len;
+}
+
+uint64_t ksnprintf(char* buf, uint64_t size, const char* fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	uint64_t len = kvsnprintf(buf, size, fmt, args);
+	va_end(args);
+	return len;
+}
+
+long kprintf(const char* fmt, ...) {
+	char buf[KPRINTF_BUFFER];
+	va_list args;
+	va_start(args, fmt);
+	uint64_t len = kvsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+
+	if (sizeof(buf) <= len) {
+		len = sizeof(buf) - 1;
+	}
+	return console_write(buf, len);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stdint.h>
+
+// Freestanding printf. Supports %d %i %u %x %X %p %c %s %%, the `-`, `0` and
+// `#` flags, field widths and string precisions (both can be `*`) and the
+// `l`, `ll` and `z` length modifiers.
+//
+// Like snprintf: always NUL terminates (if size isn't 0) and returns the
+// length the whole output would have had.
+[[gnu::format(printf, 3, 0)]]
+uint64_t kvsnprintf(char* buf, uint64_t size, const char* fmt, va_list args);
+[[gnu::format(printf, 3, 4)]]
+uint64_t ksnprintf(char* buf, uint64_t size, const char* fmt, ...);
+
+// Renders the message and sends it to the console in a single write.
+// Returns 0 or the SBI error.
+[[gnu::format(printf, 1, 2)]]
+long kprintf(const char* fmt, ...);
@@ -0,0 +1,225 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fdt.h"
+#include "klog.h"
+#include "utils.h"
+
+#include "plic.h"
+
+#define PLIC_PRIORITY  0x0
+#define PLIC_ENABLE    0x2000
+#define PLIC_CONTEXT   0x200000
+
+// El layout de QEMU virt, por si no hay device tree
+#define VIRT_PLIC_BASE 0xC000000
+#define VIRT_PLIC_NDEV 95
+
+// Las interrupciones locales del hart según interrupts-extended
+#define HART_S_EXTERNAL 9
+
+static volatile uint32_t* plic_base = (void*) VIRT_PLIC_BASE;
+static uint32_t plic_ndev = VIRT_PLIC_NDEV;
+static int32_t plic_s_context[PLIC_MAX_HARTS];
+
+static
+volatile uint32_t* plic_enable_word(uint32_t context, uint32_t source) {
+	return plic_base + (PLIC_ENABLE + 0x80 * context) / 4 + source / 32;
+}
+
+static
+volatile uint32_t* plic_context_regs(uint32_t context) {
+	return plic_base + (PLIC_CONTEXT + 0x1000 * context) / 4;
+}
+
+// Lo que se junta recorriendo el device tree. Los phandles de los
+// interrupt-controller de cada cpu se guardan con su hartid porque el nodo
+// del PLIC los referencia y puede aparecer antes o después que /cpus.
+#define FDT_MAX_CONTEXTS (2 * PLIC_MAX_HARTS)
+#define FDT_MAX_DEPTH 8
+
+struct plic_fdt {
+	uint32_t address_cells[FDT_MAX_DEPTH];
+	bool in_cpus;
+	bool in_cpu;
+	uint32_t cpu_hart;
+	uint32_t intc_phandle[PLIC_MAX_HARTS];
+	uint32_t intc_hart[PLIC_MAX_HARTS];
+	uint32_t intc_count;
+
+	// Del nodo actual, para cuando termina
+	bool is_plic;
+	bool is_intc;
+	uint32_t phandle;
+	uint64_t reg;
+	uint32_t ndev;
+	const uint32_t* contexts;
+	uint32_t contexts_len;
+
+	bool found;
+	uint64_t plic_reg;
+	uint32_t plic_ndev;
+	const uint32_t* plic_contexts;
+	uint32_t plic_contexts_len;
+};
+
+// Las propiedades de un nodo vienen antes que sus hijos, así que un nodo
+// queda completo cuando empieza su primer hijo o cuando termina
+static
+void plic_fdt_finish_node(struct plic_fdt* f) {
+	if (f->is_intc && f->in_cpu && f->cpu_hart < PLIC_MAX_HARTS && f->intc_count < PLIC_MAX_HARTS) {
+		f->intc_phandle[f->intc_count] = f->phandle;
+		f->intc_hart[f->intc_count] = f->cpu_hart;
+		f->intc_count++;
+	}
+	if (f->is_plic && !f->found) {
+		f->found = true;
+		f->plic_reg = f->reg;
+		f->plic_ndev = f->ndev;
+		f->plic_contexts = f->contexts;
+		f->plic_contexts_len = f->contexts_len;
+	}
+	f->is_plic = false;
+	f->is_intc = false;
+}
+
+static
+void plic_fdt_begin_node(void* ctx, uint32_t depth, const char* name) {
+	struct plic_fdt* f = ctx;
+	plic_fdt_finish_node(f);
+	if (depth + 1 < FDT_MAX_DEPTH) {
+		// El default de la especificación
+		f->address_cells[depth + 1] = 2;
+	}
+	if (depth == 1) {
+		f->in_cpus = str_eq(name, "cpus");
+	}
+	if (depth == 2 && f->in_cpus) {
+		f->in_cpu = true;
+		f->cpu_hart = UINT32_MAX;
+	}
+	f->phandle = 0;
+	f->ndev = 0;
+	f->contexts = 0x0;
+	f->contexts_len = 0;
+}
+
+static
+void plic_fdt_prop(void* ctx, uint32_t depth, const char* name, const void* value, uint32_t len) {
+	struct plic_fdt* f = ctx;
+	uint32_t cells = depth < FDT_MAX_DEPTH ? f->address_cells[depth] : 2;
+
+	if (str_eq(name, "#address-cells") && depth + 1 < FDT_MAX_DEPTH) {
+		f->address_cells[depth + 1] = fdt_u32(value);
+	} else if (str_eq(name, "compatible")) {
+		f->is_plic = fdt_has_string(value, len, "riscv,plic0") || fdt_has_string(value, len, "sifive,plic-1.0.0");
+		f->is_intc = fdt_has_string(value, len, "riscv,cpu-intc");
+	} else if (str_eq(name, "reg") && 4 * cells <= len) {
+		f->reg = fdt_cells(value, cells);
+		if (depth == 2 && f->in_cpu) {
+			f->cpu_hart = f->reg;
+		}
+	} else if (str_eq(name, "phandle")) {
+		f->phandle = fdt_u32(value);
+	} else if (str_eq(name, "riscv,ndev")) {
+		f->ndev = fdt_u32(value);
+	} else if (str_eq(name, "interrupts-extended")) {
+		f->contexts = value;
+		f->contexts_len = len / 4;
+	}
+}
+
+static
+void plic_fdt_end_node(void* ctx, uint32_t depth) {
+	struct plic_fdt* f = ctx;
+	plic_fdt_finish_node(f);
+	if (depth == 2) {
+		f->in_cpu = false;
+	}
+}
+
+static
+const struct fdt_walker plic_fdt_walker = {
+	.begin_node = plic_fdt_begin_node,
+	.prop = plic_fdt_prop,
+	.end_node = plic_fdt_end_node,
+};
+
+void plic_init(const void* fdt) {
+	// Estática para no tenerla en el stack, plic_init corre una sola vez
+	static struct plic_fdt f;
+	f.address_cells[0] = 2;
+
+	for (uint32_t i = 0; i < PLIC_MAX_HARTS; i++) {
+		plic_s_context[i] = 2 * i + 1;
+	}
+
+	if (!fdt_walk(fdt, &plic_fdt_walker, &f) || !f.found) {
+		klog(KLOG_WARN, "plic: not in the device tree, using the virt layout");
+		return;
+	}
+
+	plic_base = (void*) f.plic_reg;
+	if (f.plic_ndev != 0 && f.plic_ndev < PLIC_SOURCES) {
+		plic_ndev = f.plic_ndev;
+	}
+
+	// interrupts-extended son pares <phandle irq>, el índice del par es el
+	// número de contexto
+	for (uint32_t i = 0; i < PLIC_MAX_HARTS; i++) {
+		plic_s_context[i] = -1;
+	}
+	for (uint32_t context = 0; 2 * context + 1 < f.plic_contexts_len; context++) {
+		uint32_t phandle = fdt_u32(&f.plic_contexts[2 * context]);
+		uint32_t irq = fdt_u32(&f.plic_contexts[2 * context + 1]);
+		if (irq != HART_S_EXTERNAL) continue;
+		for (uint32_t j = 0; j < f.intc_count; j++) {
+			if (f.intc_phandle[j] == phandle) {
+				plic_s_context[f.intc_hart[j]] = context;
+			}
+		}
+	}
+	klog(KLOG_INFO, "plic: 0x%lX, %u sources, hart 0 on context %d", f.plic_reg, plic_ndev, plic_s_context[0]);
+}
+
+uint32_t plic_sources(void) {
+	return plic_ndev + 1;
+}
+
+int32_t plic_context(uint32_t hart) {
+	return hart < PLIC_MAX_HARTS ? plic_s_context[hart] : -1;
+}
+
+void plic_set_priority(uint32_t source, uint32_t priority) {
+	if (source == 0 || plic_ndev < source) return;
+	plic_base[PLIC_PRIORITY / 4 + source] = priority;
+}
+
+void plic_set_threshold(uint32_t context, uint32_t threshold) {
+	plic_context_regs(context)[0] = threshold;
+}
+
+void plic_enable(uint32_t context, uint32_t source) {
+	if (source == 0 || plic_ndev < source) return;
+	volatile uint32_t* word = plic_enable_word(context, source);
+	*word = *word | 1u << (source % 32);
+}
+
+void plic_disable(uint32_t context, uint32_t source) {
+	if (source == 0 || plic_ndev < source) return;
+	volatile uint32_t* word = plic_enable_word(context, source);
+	*word = *word & ~(1u << (source % 32));
+}
+
+bool plic_is_enabled(uint32_t context, uint32_t source) {
+	if (source == 0 || plic_ndev < source) return false;
+	return (*plic_enable_word(context, source) >> (source % 32)) & 1;
+}
+
+uint32_t plic_claim(uint32_t context) {
+	return plic_context_regs(context)[1];
+}
+
+void plic_complete(uint32_t context, uint32_t source) {
+	plic_context_regs(context)[1] = source;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "smp.h"
+
+// Platform-Level Interrupt Controller
+// https://github.com/riscv/riscv-plic-spec/blob/master/riscv-plic.adoc
+//
+// Source 0 means "no interrupt", so the usable sources are 1 to 1023.
+// Each hart has one context per privilege mode that takes interrupts, the
+// S-mode ones are the only ones we touch.
+#define PLIC_SOURCES 1024
+#define PLIC_MAX_HARTS SMP_MAX_HARTS
+#define PLIC_MAX_PRIORITY 7
+
+// Finds the PLIC, its number of sources and the S-mode context of every
+// hart in the device tree. Without one (or if it has no PLIC) it falls back
+// to QEMU virt's layout, where hart N's S-mode context is 2 * N + 1.
+void plic_init(const void* fdt);
+// Number of sources the PLIC implements (riscv,ndev), plus source 0
+uint32_t plic_sources(void);
+// S-mode context of `hart`, -1 if it has none
+int32_t plic_context(uint32_t hart);
+
+// 0 disables the source
+void plic_set_priority(uint32_t source, uint32_t priority);
+// Only sources with a priority above the threshold reach the context
+void plic_set_threshold(uint32_t context, uint32_t threshold);
+void plic_enable(uint32_t context, uint32_t source);
+void plic_disable(uint32_t context, uint32_t source);
+bool plic_is_enabled(uint32_t context, uint32_t source);
+uint32_t plic_claim(uint32_t context);
+void plic_complete(uint32_t context, uint32_t source);
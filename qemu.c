@@ -97,3 +97,31 @@ bool fw_cfg_dma_read(void* to_addr, uint32_t size) {
 bool fw_cfg_dma_write(void* from_addr, uint32_t size) {
 	return fw_cfg_dma_transfer(0, FW_CFG_DMA_WRITE, size, from_addr);
 }
+
+bool fw_cfg_find_file(const char* name, uint16_t* selector, uint32_t* size) {
+	uint32_t count;
+	struct {
+		uint32_t size;
+		uint16_t select;
+		uint16_t reserved;
+		char name[56];
+	} file;
+
+	if (fw_cfg_dma_read_from(FW_CFG_FILE_DIR, &count, sizeof(count))) {
+		return true;
+	}
+	count = bswap4(count);
+	for (uint32_t i = 0; i < count; i++) {
+		if (fw_cfg_dma_read(&file, sizeof(file))) {
+			return true;
+		}
+		if (str_eq(name, file.name)) {
+			*selector = bswap2(file.select);
+			if (size != 0x0) {
+				*size = bswap4(file.size);
+			}
+			return false;
+		}
+	}
+	return true;
+}
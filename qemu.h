@@ -13,3 +13,4 @@ bool fw_cfg_dma_read_from(uint16_t selector_from, void* to_addr, uint32_t size);
 bool fw_cfg_dma_write_to(uint16_t selector_to, void* from_addr, uint32_t size);
 bool fw_cfg_dma_read(void* to_addr, uint32_t size);
 bool fw_cfg_dma_write(void* from_addr, uint32_t size);
+bool fw_cfg_find_file(const char* name, uint16_t* selector, uint32_t* size);
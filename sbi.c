@@ -182,5 +182,18 @@ struct sbiret sbi_debug_console_write(
 	unsigned long base_addr_lo,
 	unsigned long base_addr_hi
 ) {
-	sbi_call3(num_bytes, base_addr_lo, base_addr_hi, 0x4442434E, 0);
+	return sbi_call3(num_bytes, base_addr_lo, base_addr_hi, 0x4442434E, 0);
+}
+
+/* Hart State Management Extension */
+struct sbiret sbi_hart_start(unsigned long hartid, unsigned long start_addr, unsigned long opaque) {
+	return sbi_call3(hartid, start_addr, opaque, 0x48534D, 0);
+}
+
+struct sbiret sbi_hart_stop(void) {
+	return sbi_call0(0x48534D, 1);
+}
+
+struct sbiret sbi_hart_get_status(unsigned long hartid) {
+	return sbi_call1(hartid, 0x48534D, 2);
 }
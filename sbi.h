@@ -52,3 +52,10 @@ struct sbiret sbi_debug_console_write(
 	unsigned long base_addr_lo,
 	unsigned long base_addr_hi
 );
+
+/* Hart State Management Extension */
+// The hart starts at start_addr in S-mode with a0 = hartid, a1 = opaque,
+// paging and interrupts off
+struct sbiret sbi_hart_start(unsigned long hartid, unsigned long start_addr, unsigned long opaque);
+struct sbiret sbi_hart_stop(void);
+struct sbiret sbi_hart_get_status(unsigned long hartid);
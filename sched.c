@@ -0,0 +1,299 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "encoding.h"
+#include "fb.h"
+#include "idle.h"
+#include "interrupts.h"
+#include "kprintf.h"
+#include "sbi.h"
+#include "smp.h"
+#include "timer.h"
+
+#include "sched.h"
+
+// Tareas por tanda de task_parallel_for, viven en su stack
+#define PARALLEL_BATCH 32
+// Potencia de 2, los índices corren libres y se enmascaran
+#define DEQUE_SIZE 256
+
+// Chase-Lev con los órdenes de memoria de Lê, Pop, Cohen y Zappa Nardelli,
+// "Correct and Efficient Work-Stealing for Weak Memory Models" (PPoPP '13).
+// Sólo el dueño toca bottom; top avanza con CAS, tanto el dueño (cuando
+// compite por la última tarea) como los ladrones.
+struct deque {
+	int64_t top;
+	int64_t bottom;
+	struct task* tasks[DEQUE_SIZE];
+} __attribute__((aligned(64)));
+
+static struct deque deques[SMP_MAX_HARTS];
+static uint64_t sched_active = UINT64_MAX;
+// Harts dormidos (o por dormirse) en sched_worker
+static uint64_t sched_sleeping;
+
+static
+bool deque_push(struct deque* d, struct task* task) {
+	int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+	int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+	if (DEQUE_SIZE <= b - t) {
+		return false;
+	}
+	__atomic_store_n(&d->tasks[b % DEQUE_SIZE], task, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+	return true;
+}
+
+static
+struct task* deque_pop(struct deque* d) {
+	int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+	__atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	int64_t t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+
+	if (b < t) {
+		// Estaba vacía
+		__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+		return 0x0;
+	}
+
+	struct task* task = __atomic_load_n(&d->tasks[b % DEQUE_SIZE], __ATOMIC_RELAXED);
+	if (t == b) {
+		// La última: hay que ganarle a los ladrones
+		if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+			task = 0x0;
+		}
+		__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+	}
+	return task;
+}
+
+static
+struct task* deque_steal(struct deque* d) {
+	int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+	if (b <= t) {
+		return 0x0;
+	}
+
+	struct task* task = __atomic_load_n(&d->tasks[t % DEQUE_SIZE], __ATOMIC_RELAXED);
+	if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+		// Otro se la llevó
+		return 0x0;
+	}
+	return task;
+}
+
+static
+bool deque_empty(struct deque* d) {
+	return __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE) <= __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+}
+
+static
+bool sched_is_active(uint32_t hart) {
+	return (__atomic_load_n(&sched_active, __ATOMIC_RELAXED) >> hart) & 1;
+}
+
+// Primero lo propio, después se roba empezando por el hart siguiente así
+// no van todos contra el mismo
+static
+struct task* sched_next(void) {
+	uint32_t self = this_cpu()->hartid;
+	struct task* task = deque_pop(&deques[self]);
+	if (task != 0x0 || !sched_is_active(self)) {
+		return task;
+	}
+
+	uint64_t online = smp_online_mask();
+	for (uint32_t i = 1; i < SMP_MAX_HARTS; i++) {
+		uint32_t victim = (self + i) % SMP_MAX_HARTS;
+		if (!(online & (1ull << victim))) continue;
+		task = deque_steal(&deques[victim]);
+		if (task != 0x0) {
+			return task;
+		}
+	}
+	return 0x0;
+}
+
+static
+void sched_run(struct task* task) {
+	task->fn(task->arg);
+	__atomic_store_n(&task->done, 1, __ATOMIC_RELEASE);
+}
+
+// Despierta a un hart dormido que pueda robar
+static
+void sched_wake_one(void) {
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	uint64_t candidates = __atomic_load_n(&sched_sleeping, __ATOMIC_RELAXED)
+		& __atomic_load_n(&sched_active, __ATOMIC_RELAXED);
+	for (uint32_t hart = 0; hart < SMP_MAX_HARTS; hart++) {
+		uint64_t bit = 1ull << hart;
+		if (!(candidates & bit)) continue;
+		// Si otro ya lo despertó se prueba con el siguiente
+		if (__atomic_fetch_and(&sched_sleeping, ~bit, __ATOMIC_RELAXED) & bit) {
+			unsigned long mask = bit;
+			sbi_send_ipi(&mask);
+			return;
+		}
+	}
+}
+
+void task_spawn(struct task* task, task_fn fn, void* arg) {
+	task->fn = fn;
+	task->arg = arg;
+	task->done = 0;
+	if (!deque_push(&deques[this_cpu()->hartid], task)) {
+		sched_run(task);
+		return;
+	}
+	sched_wake_one();
+}
+
+void task_join(struct task* task) {
+	while (!__atomic_load_n(&task->done, __ATOMIC_ACQUIRE)) {
+		struct task* other = sched_next();
+		if (other != 0x0) {
+			sched_run(other);
+		}
+	}
+}
+
+struct parallel_item {
+	struct task task;
+	task_for_fn fn;
+	void* arg;
+	uint32_t i;
+};
+
+static
+void parallel_run(void* arg) {
+	struct parallel_item* item = arg;
+	item->fn(item->arg, item->i);
+}
+
+// Se hace join de atrás para adelante: lo que nadie robó sale del fondo del
+// deque propio en el mismo orden en que task_join lo busca
+void task_parallel_for(uint32_t count, task_for_fn fn, void* arg) {
+	struct parallel_item items[PARALLEL_BATCH];
+	for (uint32_t base = 0; base < count; base += PARALLEL_BATCH) {
+		uint32_t n = count - base < PARALLEL_BATCH ? count - base : PARALLEL_BATCH;
+		for (uint32_t i = 1; i < n; i++) {
+			items[i].fn = fn;
+			items[i].arg = arg;
+			items[i].i = base + i;
+			task_spawn(&items[i].task, parallel_run, &items[i]);
+		}
+		fn(arg, base);
+		for (uint32_t i = n - 1; 1 <= i; i--) {
+			task_join(&items[i].task);
+		}
+	}
+}
+
+static
+void sched_handle_ipi(void) {
+	clear_csr(sip, SIP_SSIP);
+}
+
+// Corre con interrupciones apagadas, después de anotarse en
+// sched_sleeping: un spawn que no vea nada acá ve el bit y manda el IPI
+static
+bool sched_pending(void) {
+	if (!sched_is_active(this_cpu()->hartid)) {
+		return false;
+	}
+	uint64_t online = smp_online_mask();
+	for (uint32_t hart = 0; hart < SMP_MAX_HARTS; hart++) {
+		if ((online & (1ull << hart)) && !deque_empty(&deques[hart])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void sched_worker(void) {
+	uint64_t bit = 1ull << this_cpu()->hartid;
+	interrupts_local_enable(SOFTWARE_IRQ, sched_handle_ipi);
+
+	while (true) {
+		struct task* task = sched_next();
+		if (task != 0x0) {
+			sched_run(task);
+			continue;
+		}
+
+		__atomic_fetch_or(&sched_sleeping, bit, __ATOMIC_SEQ_CST);
+		idle_wait(sched_pending);
+		__atomic_fetch_and(&sched_sleeping, ~bit, __ATOMIC_RELAXED);
+	}
+}
+
+void sched_set_active(uint64_t mask) {
+	__atomic_store_n(&sched_active, mask, __ATOMIC_RELEASE);
+}
+
+#ifdef SCHED_BENCH
+#define SCHED_BENCH_SCREENS 8
+// Filas de texto como máximo, de sobra para 1024x768
+#define SCHED_BENCH_ROWS 256
+
+static char bench_line[128];
+
+// Una fila de texto de punta a punta
+static
+void bench_row(void* arg) {
+	uint32_t y = (uintptr_t) arg * fb.font->height;
+	fb_draw_text_run(bench_line, sizeof(bench_line), 0, y, 0x0, (rgb_t) { .R = 255, .G = 255, .B = 255 });
+}
+
+// Una tarea por fila, devuelve ticks por pantalla
+static
+uint64_t bench_screens(void) {
+	static struct task rows[SCHED_BENCH_ROWS];
+	uint32_t count = fb.height / fb.font->height;
+	if (SCHED_BENCH_ROWS < count) count = SCHED_BENCH_ROWS;
+
+	uint64_t start = rdtime();
+	for (int i = 0; i < SCHED_BENCH_SCREENS; i++) {
+		for (uint32_t row = 0; row < count; row++) {
+			task_spawn(&rows[row], bench_row, (void*) (uintptr_t) row);
+		}
+		for (uint32_t row = 0; row < count; row++) {
+			task_join(&rows[row]);
+		}
+	}
+	uint64_t ticks = (rdtime() - start) / SCHED_BENCH_SCREENS;
+	return ticks != 0 ? ticks : 1;
+}
+
+void sched_bench(void) {
+	for (uint32_t i = 0; i < sizeof(bench_line); i++) {
+		bench_line[i] = '!' + i % 94;
+	}
+
+	uint64_t online = smp_online_mask();
+	uint64_t mask = 1ull << this_cpu()->hartid;
+	uint32_t harts = 1;
+	uint64_t single = 0;
+
+	kprintf("sched_bench: %ux%u of text, us per screen\n", fb.width, fb.height);
+	while (true) {
+		sched_set_active(mask);
+		uint64_t ticks = bench_screens();
+		if (harts == 1) single = ticks;
+		uint64_t speedup = single * 100 / ticks;
+		kprintf("  %u harts: %lu us (x%lu.%02lu)\n", harts, ticks / TIMER_US(1), speedup / 100, speedup % 100);
+
+		// Se suma el siguiente hart online
+		uint64_t rest = online & ~mask;
+		if (rest == 0) break;
+		mask |= rest & -rest;
+		harts++;
+	}
+	sched_set_active(UINT64_MAX);
+}
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Fork/join tasks over every online hart. Each hart has a Chase-Lev deque:
+// it pushes and pops its own tasks at the bottom while idle harts steal
+// from the top. Harts with nothing to steal sleep in wfi and spawning a
+// task wakes one of them with an IPI.
+
+typedef void (*task_fn)(void* arg);
+
+// Owned by the caller, it must stay alive until task_join returns
+struct task {
+	task_fn fn;
+	void* arg;
+	uint32_t done;
+};
+
+// Safe from any hart outside interrupt context. If this hart's deque is
+// full the task runs right away.
+void task_spawn(struct task* task, task_fn fn, void* arg);
+// Runs (or steals) other tasks while it waits, so it never blocks a hart
+void task_join(struct task* task);
+
+// Runs fn(arg, i) for every i < count, one task each, and returns once all
+// of them are done. The calling hart takes i = 0 itself. Fits
+// fb_set_parallel.
+typedef void (*task_for_fn)(void* arg, uint32_t i);
+void task_parallel_for(uint32_t count, task_for_fn fn, void* arg);
+
+// On each secondary hart, never returns
+[[gnu::noreturn]]
+void sched_worker(void);
+// Only the harts in `mask` run tasks, the rest stay asleep. Everyone by
+// default.
+void sched_set_active(uint64_t mask);
+// Renders full screens of text with 1 to N harts (BENCH=1)
+void sched_bench(void);
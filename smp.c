@@ -0,0 +1,91 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fb.h"
+#include "interrupts.h"
+#include "klog.h"
+#include "sbi.h"
+#include "sched.h"
+#include "timer.h"
+
+#include "smp.h"
+
+#define SBI_EXT_HSM 0x48534D
+#define SBI_HSM_STATE_STOPPED 1
+
+// Cuánto esperar a que un hart avise que arrancó
+#define SMP_START_TIMEOUT TIMER_MS(100)
+
+struct percpu percpu[SMP_MAX_HARTS];
+static uint64_t smp_online;
+
+// En start.s: arma gp, el stack del hart y tp = a1, y salta a
+// secondary_main
+extern uint8_t _start_secondary[];
+
+void smp_init_boot(uint32_t hartid) {
+	struct percpu* cpu = &percpu[hartid];
+	cpu->hartid = hartid;
+	cpu->online = true;
+	asm volatile ("mv tp, %0" :: "r" (cpu));
+	__atomic_fetch_or(&smp_online, 1ull << hartid, __ATOMIC_RELEASE);
+}
+
+// Arranca con interrupciones apagadas, stack propio y tp apuntando a su
+// percpu
+[[gnu::noreturn]]
+void secondary_main(unsigned long hartid) {
+	struct percpu* cpu = this_cpu();
+	cpu->hartid = hartid;
+	interrupts_enable();
+	timer_init_hart();
+	fb_init_hart();
+
+	__atomic_store_n(&cpu->online, true, __ATOMIC_RELEASE);
+	__atomic_fetch_or(&smp_online, 1ull << hartid, __ATOMIC_RELEASE);
+	klog(KLOG_INFO, "smp: hart %lu online", hartid);
+
+	sched_worker();
+}
+
+uint32_t smp_start_secondaries(void) {
+	if (sbi_probe_extension(SBI_EXT_HSM).value == 0) {
+		klog(KLOG_WARN, "smp: no HSM extension, running on one hart");
+		return smp_online_count();
+	}
+
+	uint32_t self = this_cpu()->hartid;
+	for (uint32_t hart = 0; hart < SMP_MAX_HARTS; hart++) {
+		if (hart == self) continue;
+		// Los harts que no existen dan SBI_ERR_INVALID_PARAM
+		struct sbiret status = sbi_hart_get_status(hart);
+		if (status.error != SBI_SUCCESS || status.value != SBI_HSM_STATE_STOPPED) continue;
+
+		struct sbiret ret = sbi_hart_start(hart, (unsigned long) _start_secondary, (unsigned long) &percpu[hart]);
+		if (ret.error != SBI_SUCCESS) {
+			klog(KLOG_WARN, "smp: hart %u did not start (%ld)", hart, ret.error);
+			continue;
+		}
+
+		uint64_t deadline = timer_now() + SMP_START_TIMEOUT;
+		while (!__atomic_load_n(&percpu[hart].online, __ATOMIC_ACQUIRE) && !timer_expired(deadline));
+		if (!percpu[hart].online) {
+			klog(KLOG_WARN, "smp: hart %u started but never came online", hart);
+		}
+	}
+	return smp_online_count();
+}
+
+uint64_t smp_online_mask(void) {
+	return __atomic_load_n(&smp_online, __ATOMIC_ACQUIRE);
+}
+
+uint32_t smp_online_count(void) {
+	uint64_t mask = smp_online_mask();
+	uint32_t count = 0;
+	while (mask != 0) {
+		count += mask & 1;
+		mask >>= 1;
+	}
+	return count;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Harts are indexed by hartid, anything at or above this stays parked in
+// start.s. linker.ld reserves a stack for each one.
+#define SMP_MAX_HARTS 8
+
+struct timer;
+
+// Per-CPU data, each hart keeps a pointer to its own block in tp. Only the
+// owning hart writes to it.
+struct percpu {
+	uint32_t hartid;
+	bool online;
+	// Pending timers, see timer.c
+	struct timer* timer_queue;
+	// Busy/idle accounting, see idle.c
+	uint64_t idle_busy;
+	uint64_t idle_idle;
+	uint64_t idle_wakeups;
+	uint64_t idle_last;
+};
+
+extern struct percpu percpu[SMP_MAX_HARTS];
+
+static inline
+struct percpu* this_cpu(void) {
+	struct percpu* cpu;
+	asm ("mv %0, tp" : "=r" (cpu));
+	return cpu;
+}
+
+// Sets up the boot hart's per-CPU block, before anything else uses it
+void smp_init_boot(uint32_t hartid);
+// Starts every other hart through the SBI HSM extension and waits for them
+// to come online. Returns how many harts are running, counting this one.
+uint32_t smp_start_secondaries(void);
+// Number of harts online and a mask of them (bit i is hart i)
+uint32_t smp_online_count(void);
+uint64_t smp_online_mask(void);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+// Test-and-test-and-set lock for short critical sections shared between
+// harts. It doesn't mask interrupts: don't take one from a handler.
+typedef struct {
+	uint32_t locked;
+} spinlock_t;
+
+static inline
+void spin_lock(spinlock_t* lock) {
+	while (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE)) {
+		while (__atomic_load_n(&lock->locked, __ATOMIC_RELAXED));
+	}
+}
+
+static inline
+void spin_unlock(spinlock_t* lock) {
+	__atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
@@ -1,15 +1,52 @@
+# Per-hart stacks, keep in sync with linker.ld and SMP_MAX_HARTS in smp.h
+.equ KERNEL_STACK_SIZE, 0x80000
+.equ SMP_MAX_HARTS, 8
+
 .section .text, "ax"
-.global _start
-_start:
-    .cfi_startproc
-    .cfi_undefined ra
+
+# a0 = hartid, kernel_stacks + (hartid + 1) * KERNEL_STACK_SIZE en sp. Los
+# harts sin lugar se quedan estacionados.
+.macro HART_STACK
+    li t0, SMP_MAX_HARTS
+    bgeu a0, t0, park
+    addi t0, a0, 1
+    li t1, KERNEL_STACK_SIZE
+    mul t0, t0, t1
+    la sp, kernel_stacks
+    add sp, sp, t0
+.endm
+
+.macro SET_GP
     .option push
     .option norelax
     1: auipc gp, %pcrel_hi(__global_pointer$)
     addi gp, gp, %pcrel_lo(1b)
     .option pop
-    la sp, kernel_stack_top
+.endm
+
+.global _start
+_start:
+    .cfi_startproc
+    .cfi_undefined ra
+    SET_GP
+    HART_STACK
     add s0, sp, zero
     jal zero, main
     .cfi_endproc
+
+# Entrada de los harts que arranca smp_start_secondaries, a1 = su percpu
+.global _start_secondary
+_start_secondary:
+    .cfi_startproc
+    .cfi_undefined ra
+    SET_GP
+    HART_STACK
+    mv tp, a1
+    add s0, sp, zero
+    jal zero, secondary_main
+    .cfi_endproc
+
+park:
+    wfi
+    j park
     .end
@@ -0,0 +1,148 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "encoding.h"
+#include "interrupts.h"
+#include "klog.h"
+#include "sbi.h"
+#include "smp.h"
+
+#include "timer.h"
+
+#define CAUSE_ILLEGAL_INSTRUCTION 2
+
+bool timer_has_sstc;
+
+// Cada hart tiene su cola en el percpu, ordenada por deadline. La cabeza
+// es lo único que está programado en el comparador de ese hart.
+#define timer_queue (this_cpu()->timer_queue)
+
+static
+void timer_program(uint64_t deadline) {
+	// Escribir el comparador también baja STIP. stimecmp (0x14D) va por
+	// número para no depender de que el assembler conozca Sstc.
+	if (timer_has_sstc) {
+		write_csr(0x14D, deadline);
+	} else {
+		sbi_set_timer(deadline);
+	}
+}
+
+static
+void timer_unlink(struct timer* timer) {
+	struct timer** link = &timer_queue;
+	while (*link != 0x0 && *link != timer) {
+		link = &(*link)->next;
+	}
+	if (*link == timer) {
+		*link = timer->next;
+	}
+	timer->next = 0x0;
+	timer->armed = false;
+}
+
+static
+void timer_insert(struct timer* timer) {
+	struct timer** link = &timer_queue;
+	while (*link != 0x0 && (*link)->deadline <= timer->deadline) {
+		link = &(*link)->next;
+	}
+	timer->next = *link;
+	timer->armed = true;
+	*link = timer;
+}
+
+// Sin nada pendiente el comparador queda en el máximo: no hay ticks
+static
+void timer_reprogram(void) {
+	timer_program(timer_queue != 0x0 ? timer_queue->deadline : UINT64_MAX);
+}
+
+static
+void timer_handle_irq(void) {
+	uint64_t now = rdtime();
+	while (timer_queue != 0x0 && timer_queue->deadline <= now) {
+		struct timer* timer = timer_queue;
+		timer_queue = timer->next;
+		timer->next = 0x0;
+		timer->armed = false;
+
+		if (timer->period != 0) {
+			uint64_t missed = (now - timer->deadline) / timer->period;
+			timer->deadline += (missed + 1) * timer->period;
+			timer_insert(timer);
+		}
+		timer->fn(timer, timer->arg);
+		now = rdtime();
+	}
+	timer_reprogram();
+}
+
+// Sin Sstc leer stimecmp es una instrucción ilegal: se saltea y listo
+static
+void timer_probe_fault(void) {
+	timer_has_sstc = false;
+	write_csr(sepc, read_csr(sepc) + 4);
+}
+
+void timer_init(void) {
+	timer_has_sstc = true;
+	interrupts_exception_set(CAUSE_ILLEGAL_INSTRUCTION, timer_probe_fault);
+	(void) read_csr(0x14D);
+	interrupts_exception_set(CAUSE_ILLEGAL_INSTRUCTION, 0x0);
+
+	timer_init_hart();
+	klog(KLOG_INFO, "timer: %u Hz, %s", TIMER_FREQ, timer_has_sstc ? "Sstc" : "SBI");
+}
+
+void timer_init_hart(void) {
+	timer_program(UINT64_MAX);
+	interrupts_local_enable(TIMER_IRQ, timer_handle_irq);
+}
+
+uint64_t timer_now(void) {
+	return rdtime();
+}
+
+static
+void timer_arm(struct timer* timer, uint64_t deadline, uint64_t period, timer_fn fn, void* arg) {
+	unsigned long sie = clear_csr(sstatus, SSTATUS_SIE) & SSTATUS_SIE;
+	if (timer->armed) {
+		timer_unlink(timer);
+	}
+	timer->deadline = deadline;
+	timer->period = period;
+	timer->fn = fn;
+	timer->arg = arg;
+	bool earliest = timer_queue == 0x0 || deadline < timer_queue->deadline;
+	timer_insert(timer);
+	if (earliest) {
+		timer_program(deadline);
+	}
+	set_csr(sstatus, sie);
+}
+
+void timer_start(struct timer* timer, uint64_t deadline, timer_fn fn, void* arg) {
+	timer_arm(timer, deadline, 0, fn, arg);
+}
+
+void timer_start_periodic(struct timer* timer, uint64_t period, timer_fn fn, void* arg) {
+	timer_arm(timer, rdtime() + period, period, fn, arg);
+}
+
+void timer_cancel(struct timer* timer) {
+	unsigned long sie = clear_csr(sstatus, SSTATUS_SIE) & SSTATUS_SIE;
+	if (timer->armed) {
+		bool was_head = timer_queue == timer;
+		timer_unlink(timer);
+		if (was_head) {
+			timer_reprogram();
+		}
+	}
+	timer->period = 0;
+	set_csr(sstatus, sie);
+}
+
+bool timer_expired(uint64_t deadline) {
+	return deadline <= rdtime();
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Tickless timers. Each hart keeps its pending timers in a list sorted by
+// deadline and only the earliest one is programmed (stimecmp with Sstc, sbi_set_timer
+// otherwise), so with nothing pending the hart takes no timer interrupts.
+// Times are in `time` CSR ticks.
+
+// timebase-frequency of QEMU's virt machine
+#define TIMER_FREQ 10000000
+
+#define TIMER_US(us) ((uint64_t) (us) * (TIMER_FREQ / 1000000))
+#define TIMER_MS(ms) ((uint64_t) (ms) * (TIMER_FREQ / 1000))
+
+struct timer;
+// Runs from the timer interrupt, it may rearm or cancel any timer
+typedef void (*timer_fn)(struct timer* timer, void* arg);
+
+// Owned by the caller, it must stay alive while it's armed
+struct timer {
+	uint64_t deadline;
+	// 0 for one-shot timers
+	uint64_t period;
+	timer_fn fn;
+	void* arg;
+	struct timer* next;
+	bool armed;
+};
+
+extern bool timer_has_sstc;
+
+// Needs the trap vector installed (interrupts_enable): probing for Sstc can
+// fault. Only on the boot hart, the others call timer_init_hart.
+void timer_init(void);
+void timer_init_hart(void);
+uint64_t timer_now(void);
+// Safe from any context. The timer fires on the hart that armed it, and it
+// can only be moved or cancelled from that hart. Arming an armed timer
+// moves it.
+void timer_start(struct timer* timer, uint64_t deadline, timer_fn fn, void* arg);
+// Fires every `period` ticks starting one period from now. If callbacks
+// fall behind, missed periods are skipped instead of queued.
+void timer_start_periodic(struct timer* timer, uint64_t period, timer_fn fn, void* arg);
+void timer_cancel(struct timer* timer);
+// Timeouts: true once `deadline` has passed
+bool timer_expired(uint64_t deadline);
@@ -0,0 +1,47 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "console.h"
+
+#include "trace.h"
+
+#ifdef TRACE
+struct trace_record trace_buffer[TRACE_RECORDS];
+uint64_t trace_head;
+bool trace_paused;
+
+#define TRACE_LINE (2 * sizeof(struct trace_record) + 1)
+#define TRACE_LINES_PER_WRITE 7
+
+// Una línea de hex por registro, los bytes en el orden en que están en
+// memoria, entre "trace: begin" y "trace: end"
+void trace_dump(void) {
+	static const char table[] = "0123456789abcdef";
+	char lines[TRACE_LINE * TRACE_LINES_PER_WRITE];
+	uint32_t used = 0;
+
+	trace_paused = true;
+	uint64_t head = __atomic_load_n(&trace_head, __ATOMIC_ACQUIRE);
+	uint64_t first = TRACE_RECORDS < head ? head - TRACE_RECORDS : 0;
+
+	console_write("trace: begin\n", 13);
+	for (uint64_t i = first; i < head; i++) {
+		const uint8_t* bytes = (const uint8_t*) &trace_buffer[i % TRACE_RECORDS];
+		for (uint32_t j = 0; j < sizeof(struct trace_record); j++) {
+			lines[used++] = table[bytes[j] >> 4];
+			lines[used++] = table[bytes[j] & 0xF];
+		}
+		lines[used++] = '\n';
+
+		if (used == sizeof(lines)) {
+			console_write(lines, used);
+			used = 0;
+		}
+	}
+	console_write(lines, used);
+	console_write("trace: end\n", 11);
+
+	trace_head = 0;
+	trace_paused = false;
+}
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Binary event trace. Built with `make TRACE=1`, otherwise every trace
+// point compiles to nothing. Records are dumped as hex over the console by
+// trace_dump and turned into a timeline by utils/trace_decode.
+enum trace_event {
+	TRACE_TRAP_ENTER = 1,   // arg0 = cause code, arg1 = scause
+	TRACE_TRAP_EXIT,
+	TRACE_PLIC_CLAIM,       // arg0 = source
+	TRACE_PLIC_COMPLETE,    // arg0 = source
+	TRACE_SCANCODE,         // arg0 = scancode
+	TRACE_SCROLLBACK_BEGIN,
+	TRACE_SCROLLBACK_END,   // arg0 = rows on screen, arg1 = 1 on a full repaint
+	TRACE_PRESENT_BEGIN,    // arg0 = damaged rects
+	TRACE_PRESENT_END,
+};
+
+// The layout is shared with utils/trace_decode.c
+struct trace_record {
+	uint64_t time;
+	uint64_t cycle;
+	uint32_t event;
+	uint32_t arg0;
+	uint64_t arg1;
+};
+
+#define TRACE_RECORDS 4096
+
+#ifdef TRACE
+#include "encoding.h"
+
+extern struct trace_record trace_buffer[TRACE_RECORDS];
+extern uint64_t trace_head;
+extern bool trace_paused;
+
+// Safe from any context: each call claims its own record
+static inline
+void trace(enum trace_event event, uint32_t arg0, uint64_t arg1) {
+	if (trace_paused) return;
+	uint64_t index = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED);
+	struct trace_record* r = &trace_buffer[index % TRACE_RECORDS];
+	r->time = rdtime();
+	r->cycle = rdcycle();
+	r->event = event;
+	r->arg0 = arg0;
+	r->arg1 = arg1;
+}
+
+void trace_dump(void);
+#else
+#define trace(event, arg0, arg1) ((void) 0)
+#define trace_dump() ((void) 0)
+#endif
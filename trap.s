@@ -0,0 +1,90 @@
+.section .text, "ax"
+
+# Trap entry, installed in vectored mode: exceptions land on trap_vector and
+# interrupt `cause` on trap_vector + 4 * cause.
+#
+# Each stub only saves the caller-saved registers. The C handlers preserve
+# the rest themselves and never touch gp or tp. FP state is off (sstatus.FS)
+# and the vector code masks interrupts, so neither has to be saved. Handlers
+# run with interrupts masked, so sepc and sstatus can't be clobbered by a
+# nested trap and stay in their CSRs.
+
+.macro TRAP_SAVE
+    addi sp, sp, -128
+    sd ra, 0(sp)
+    sd t0, 8(sp)
+    sd t1, 16(sp)
+    sd t2, 24(sp)
+    sd t3, 32(sp)
+    sd t4, 40(sp)
+    sd t5, 48(sp)
+    sd t6, 56(sp)
+    sd a0, 64(sp)
+    sd a1, 72(sp)
+    sd a2, 80(sp)
+    sd a3, 88(sp)
+    sd a4, 96(sp)
+    sd a5, 104(sp)
+    sd a6, 112(sp)
+    sd a7, 120(sp)
+.endm
+
+.macro TRAP_RESTORE
+    ld ra, 0(sp)
+    ld t0, 8(sp)
+    ld t1, 16(sp)
+    ld t2, 24(sp)
+    ld t3, 32(sp)
+    ld t4, 40(sp)
+    ld t5, 48(sp)
+    ld t6, 56(sp)
+    ld a0, 64(sp)
+    ld a1, 72(sp)
+    ld a2, 80(sp)
+    ld a3, 88(sp)
+    ld a4, 96(sp)
+    ld a5, 104(sp)
+    ld a6, 112(sp)
+    ld a7, 120(sp)
+    addi sp, sp, 128
+    sret
+.endm
+
+# With stamp=1 the handler gets the cycle count at entry in a0
+.macro TRAP_STUB name, handler, stamp=0
+\name:
+    TRAP_SAVE
+    .if \stamp
+    csrr a0, cycle
+    .endif
+    call \handler
+    TRAP_RESTORE
+.endm
+
+# Every slot has to be exactly 4 bytes, no compressed jumps here
+.balign 64
+.global trap_vector
+trap_vector:
+    .option push
+    .option norvc
+    j trap_exception_entry  # 0: exceptions
+    j trap_software_entry   # 1: supervisor software interrupt
+    j trap_spurious_entry   # 2
+    j trap_spurious_entry   # 3
+    j trap_spurious_entry   # 4
+    j trap_timer_entry      # 5: supervisor timer interrupt
+    j trap_spurious_entry   # 6
+    j trap_spurious_entry   # 7
+    j trap_spurious_entry   # 8
+    j trap_external_entry   # 9: supervisor external interrupt
+    j trap_spurious_entry   # 10
+    j trap_spurious_entry   # 11
+    j trap_spurious_entry   # 12
+    j trap_spurious_entry   # 13: counter overflow
+    .option pop
+
+TRAP_STUB trap_exception_entry, trap_exception
+TRAP_STUB trap_software_entry, trap_software
+TRAP_STUB trap_timer_entry, trap_timer
+TRAP_STUB trap_external_entry, trap_external, 1
+TRAP_STUB trap_spurious_entry, trap_spurious
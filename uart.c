@@ -0,0 +1,113 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "encoding.h"
+#include "interrupts.h"
+
+#include "uart.h"
+
+// Tamaños potencia de 2, los índices corren libres y se enmascaran. Cada
+// cola tiene un solo productor y un solo consumidor: RX la llena el handler
+// y la vacía uart_read, TX al revés.
+#define UART_RX_RING 1024
+#define UART_TX_RING 4096
+
+static char uart_rx_ring[UART_RX_RING];
+static uint32_t uart_rx_head;
+static uint32_t uart_rx_tail;
+static uint64_t uart_rx_lost;
+
+static char uart_tx_ring[UART_TX_RING];
+static uint32_t uart_tx_head;
+static uint32_t uart_tx_tail;
+
+// Con THRE el FIFO de transmisión está vacío y entran 16 bytes sin mirar
+// LSR entre cada uno. La interrupción de THRE queda prendida sólo mientras
+// haya algo esperando.
+static
+void uart_fill_tx_fifo(void) {
+	if (!(uart->lsr & NS16550_LSR.THRE)) return;
+
+	uint32_t tail = uart_tx_tail;
+	uint32_t head = __atomic_load_n(&uart_tx_head, __ATOMIC_ACQUIRE);
+	for (uint32_t i = 0; i < NS16550_FIFO_SIZE && tail != head; i++) {
+		uart->data = uart_tx_ring[tail++ % UART_TX_RING];
+	}
+	__atomic_store_n(&uart_tx_tail, tail, __ATOMIC_RELEASE);
+
+	if (tail == head) {
+		uart->ier = uart->ier & ~NS16550_IER.ETBEI;
+	} else {
+		uart->ier = uart->ier | NS16550_IER.ETBEI;
+	}
+}
+
+static
+void uart_handle_irq(void) {
+	// Leer IIR baja la interrupción de THRE
+	(void) uart->iir;
+
+	uint32_t head = uart_rx_head;
+	uint8_t lsr;
+	while ((lsr = uart->lsr) & NS16550_LSR.DR) {
+		if (lsr & NS16550_LSR.OE) {
+			uart_rx_lost++;
+		}
+		char c = uart->data;
+		if (head - __atomic_load_n(&uart_rx_tail, __ATOMIC_ACQUIRE) == UART_RX_RING) {
+			uart_rx_lost++;
+			continue;
+		}
+		uart_rx_ring[head++ % UART_RX_RING] = c;
+	}
+	__atomic_store_n(&uart_rx_head, head, __ATOMIC_RELEASE);
+
+	uart_fill_tx_fifo();
+}
+
+void uart_init(void) {
+	uart->ier = 0;
+	uart->lcr = NS16550_LCR_8N1;
+	// FCR está en el mismo offset que IIR
+	uart->iir = NS16550_FCR_INIT;
+	uart->mcr = NS16550_MCR_OUT2;
+
+	interrupts_external_enable(UART_IRQ, uart_handle_irq);
+	uart->ier = NS16550_IER.ERBFI;
+}
+
+uint64_t uart_read(char* dst, uint64_t size) {
+	uint32_t tail = uart_rx_tail;
+	uint32_t head = __atomic_load_n(&uart_rx_head, __ATOMIC_ACQUIRE);
+	uint64_t read = 0;
+	while (read < size && tail != head) {
+		dst[read++] = uart_rx_ring[tail++ % UART_RX_RING];
+	}
+	__atomic_store_n(&uart_rx_tail, tail, __ATOMIC_RELEASE);
+	return read;
+}
+
+uint64_t uart_write(const char* src, uint64_t size) {
+	uint32_t head = uart_tx_head;
+	uint32_t tail = __atomic_load_n(&uart_tx_tail, __ATOMIC_ACQUIRE);
+	uint64_t written = 0;
+	while (written < size && head - tail != UART_TX_RING) {
+		uart_tx_ring[head++ % UART_TX_RING] = src[written++];
+	}
+	__atomic_store_n(&uart_tx_head, head, __ATOMIC_RELEASE);
+
+	// Si el FIFO estaba vacío nadie va a interrumpir, hay que arrancarlo.
+	// El handler también lo llena, así que va sin interrupciones.
+	unsigned long sie = clear_csr(sstatus, SSTATUS_SIE) & SSTATUS_SIE;
+	uart_fill_tx_fifo();
+	set_csr(sstatus, sie);
+	return written;
+}
+
+bool uart_rx_pending(void) {
+	return __atomic_load_n(&uart_rx_head, __ATOMIC_ACQUIRE) != uart_rx_tail;
+}
+
+uint64_t uart_rx_dropped(void) {
+	return uart_rx_lost;
+}
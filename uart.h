@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// NS16550A on QEMU's virt machine, one byte per register
+// https://www.lammertbies.nl/comm/info/serial-uart
+typedef struct {
+	uint8_t data; // RBR (r) / THR (w)
+	uint8_t ier;  // interrupt enable register (rw)
+	uint8_t iir;  // interrupt identification (r) / FCR, FIFO control (w)
+	uint8_t lcr;  // line control register (rw)
+	uint8_t mcr;  // modem control register (rw)
+	uint8_t lsr;  // line status register (r)
+	uint8_t msr;  // modem status register (r)
+	uint8_t scr;  // scratch register (rw)
+} ns16550_registers;
+
+struct struct_NS16550_IER {
+	// Received data available (or RX FIFO over its trigger level)
+	uint8_t ERBFI;
+	// Transmitter holding register empty
+	uint8_t ETBEI;
+	// Receiver line status (overrun, parity, framing or break)
+	uint8_t ELSI;
+};
+constexpr struct struct_NS16550_IER NS16550_IER = { 1, 2, 4 };
+
+struct struct_NS16550_LSR {
+	// There's at least one byte in the receive FIFO
+	uint8_t DR;
+	// A byte was lost because the receive FIFO was full
+	uint8_t OE;
+	// The transmit FIFO is empty
+	uint8_t THRE;
+};
+constexpr struct struct_NS16550_LSR NS16550_LSR = { 1, 2, 32 };
+
+// Enable and clear both FIFOs, interrupt when the RX FIFO has 8 bytes
+constexpr uint8_t NS16550_FCR_INIT = 0x87;
+// 8 data bits, no parity, one stop bit
+constexpr uint8_t NS16550_LCR_8N1 = 0x03;
+// OUT2 gates the interrupt line on PC style boards
+constexpr uint8_t NS16550_MCR_OUT2 = 0x08;
+constexpr uint32_t NS16550_FIFO_SIZE = 16;
+
+#define UART_IRQ 10
+
+static volatile ns16550_registers* const uart = (void*) 0x10000000;
+
+void uart_init(void);
+// Neither call blocks: they move as much as fits and return how many bytes
+// they moved. Each one must only be used from one place outside interrupt
+// context, the rings have a single producer and a single consumer.
+uint64_t uart_read(char* dst, uint64_t size);
+uint64_t uart_write(const char* src, uint64_t size);
+// True if uart_read has something to return
+bool uart_rx_pending(void);
+// Bytes lost because the RX FIFO or the software ring overflowed
+uint64_t uart_rx_dropped(void);
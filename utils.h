@@ -2,7 +2,7 @@
 
 #include <stdbool.h>
 
-#include "sbi.h"
+#include "console.h"
 
 #define attr_packed __attribute__((packed))
 
@@ -47,56 +47,12 @@ uint16_t bswap2(uint16_t in) {
 static
 uint64_t print(const char* str) {
 	uint64_t len = 0;
-	while (*str) {
-		uint64_t res = sbi_console_putchar(*str++);
-		if (res != 0) {
-			return res;
-		}
+	while (str[len]) {
 		len++;
 	}
-	return len;
-}
-
-static
-uint64_t print_hex(uint64_t v) {
-	static const char* table = "0123456789ABCDEF";
-	char buf[19];
-	char* s;
-
-	if (v == 0) {
-		s = "0x0";
-	} else {
-		s = buf + 18;
-		while (v != 0) {
-			*--s = table[v & 0xF];
-			v >>= 4;
-		}
-		*--s = 'x';
-		*--s = '0';
-	}
-
-	return print(s);
-}
-
-
-static
-uint64_t print_sdec(int64_t v) {
-	static const char table[] = "0123456789";
-	char buf[22];
-	char* s = buf + sizeof(buf) - 1;
-	bool is_negative = v < 0;
-
-	if (is_negative) v = -v;
-
-	*s = 0;
-	do {
-		*--s = table[v % 10];
-		v /= 10;
-	} while (v != 0);
-
-	if (is_negative) {
-		*--s = '-';
+	long res = console_write(str, len);
+	if (res != 0) {
+		return res;
 	}
-
-	return print(s);
+	return len;
 }
@@ -0,0 +1,171 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_TOKEN_SIZE 128
+#define MAX_LABELS 4
+#define MAX_LABEL_BYTES 65536
+
+// Turns a font .data file (the same input as to_data_file) into the binary
+// format that fb_font_load reads from fw_cfg:
+//
+//   "MVF1" | height | first_char | count | columns | widths[count] | bitmaps
+struct label {
+	char name[MAX_TOKEN_SIZE + 1];
+	uint8_t bytes[MAX_LABEL_BYTES];
+	int size;
+};
+
+static struct label labels[MAX_LABELS];
+static int label_count;
+
+bool try_get_label(FILE* f, char* buf, size_t bufsiz, int* written) {
+	int c = fgetc(f);
+	if (c != '$') {
+		ungetc(c, f);
+		return false;
+	}
+
+	*written = 0;
+	while(*written < bufsiz) {
+		c = fgetc(f);
+		if (c == EOF || isspace(c)) return *written != 0;
+
+		buf[*written] = c;
+		*written += 1;
+	}
+	fprintf(stderr, "FATAL: Token was too big (more than %lu characters)\n", bufsiz);
+	exit(1);
+}
+
+bool try_get_hex(FILE* f, char* buf, size_t bufsiz, int* written) {
+	int c = fgetc(f);
+	ungetc(c, f);
+	if (!isxdigit(c)) {
+		return false;
+	}
+
+	*written = 0;
+	while(*written < bufsiz) {
+		c = fgetc(f);
+		if (c == EOF || isspace(c)) return *written != 0;
+
+		if (!isxdigit(c)) {
+			fprintf(stderr, "FATAL: Numeric token had non-hex digits\n");
+			exit(1);
+		}
+
+		buf[*written] = c;
+		*written += 1;
+	}
+	fprintf(stderr, "FATAL: Token was too big (more than %lu characters)\n", bufsiz);
+	exit(1);
+}
+
+void read_labels(FILE* from) {
+	char token[MAX_TOKEN_SIZE];
+	int len;
+	do {
+		if (!try_get_label(from, token, MAX_TOKEN_SIZE, &len)) {
+			if (feof(from)) break;
+			fprintf(stderr, "FATAL: Expected label but got something else\n");
+			exit(1);
+		}
+		if (label_count == MAX_LABELS) {
+			fprintf(stderr, "FATAL: Too many labels\n");
+			exit(1);
+		}
+		struct label* l = &labels[label_count++];
+		memcpy(l->name, token, len);
+		l->name[len] = 0;
+
+		while (try_get_hex(from, token, MAX_TOKEN_SIZE, &len)) {
+			if (len != 16 && len != 8 && len != 4 && len != 2) {
+				fprintf(stderr, "FATAL: Unexpected word size (%d bits)\n", len * 4);
+				exit(1);
+			}
+			for (int i = 0; i < len; i += 2) {
+				if (l->size == MAX_LABEL_BYTES) {
+					fprintf(stderr, "FATAL: Label %s is too big\n", l->name);
+					exit(1);
+				}
+				char byte[3] = { token[i], token[i + 1], 0 };
+				l->bytes[l->size++] = strtoul(byte, NULL, 16);
+			}
+		}
+	} while(1);
+}
+
+struct label* find_label(const char* name) {
+	for (int i = 0; i < label_count; i++) {
+		if (strcmp(labels[i].name, name) == 0) {
+			return &labels[i];
+		}
+	}
+	return NULL;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc != 7) {
+		printf("Usage: %s <infile> <outfile> <height> <columns> <first char> <width | width label>\n", argv[0]);
+		printf("  The width label is a table indexed by char code\n");
+		return 1;
+	}
+	const char* from_filename = argv[1];
+	const char* to_filename = argv[2];
+	int height = atoi(argv[3]);
+	int columns = atoi(argv[4]);
+	int first_char = atoi(argv[5]);
+	const char* width_arg = argv[6];
+
+	FILE* from = fopen(from_filename, "r");
+	if (from == NULL) {
+		fprintf(stderr, "FATAL: Couldn't open %s\n", from_filename);
+		return 1;
+	}
+	read_labels(from);
+	fclose(from);
+
+	if (label_count == 0) {
+		fprintf(stderr, "FATAL: No bitmap label found\n");
+		return 1;
+	}
+	struct label* bitmap = &labels[0];
+	int glyph_size = height * columns;
+	int count = bitmap->size / glyph_size;
+	if (count == 0 || 255 < count || 255 < height || 2 < columns) {
+		fprintf(stderr, "FATAL: Unsupported font geometry\n");
+		return 1;
+	}
+
+	uint8_t widths[255];
+	struct label* width_table = isdigit(width_arg[0]) ? NULL : find_label(width_arg);
+	for (int i = 0; i < count; i++) {
+		if (width_table == NULL) {
+			widths[i] = atoi(width_arg);
+		} else if (first_char + i < width_table->size) {
+			widths[i] = width_table->bytes[first_char + i];
+		} else {
+			fprintf(stderr, "FATAL: Width table %s is too short\n", width_arg);
+			return 1;
+		}
+	}
+
+	FILE* to = fopen(to_filename, "wb");
+	if (to == NULL) {
+		fprintf(stderr, "FATAL: Couldn't open %s\n", to_filename);
+		return 1;
+	}
+	fwrite("MVF1", 1, 4, to);
+	fputc(height, to);
+	fputc(first_char, to);
+	fputc(count, to);
+	fputc(columns, to);
+	fwrite(widths, 1, count, to);
+	fwrite(bitmap->bytes, 1, count * glyph_size, to);
+	fclose(to);
+	return 0;
+}
@@ -0,0 +1,134 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../trace.h"
+
+// Turns the output of trace_dump (a console log with "trace: begin", one
+// hex line per record and "trace: end") into a timeline. End events show
+// how long it was since their begin event, and a summary per span follows.
+//
+// Usage: trace_decode [log file] [timebase Hz]
+
+#define MAX_EVENT 16
+#define MAX_DEPTH 16
+
+static const char* event_names[MAX_EVENT] = {
+	[TRACE_TRAP_ENTER] = "trap enter",
+	[TRACE_TRAP_EXIT] = "trap exit",
+	[TRACE_PLIC_CLAIM] = "plic claim",
+	[TRACE_PLIC_COMPLETE] = "plic complete",
+	[TRACE_SCANCODE] = "scancode",
+	[TRACE_SCROLLBACK_BEGIN] = "scrollback begin",
+	[TRACE_SCROLLBACK_END] = "scrollback end",
+	[TRACE_PRESENT_BEGIN] = "present begin",
+	[TRACE_PRESENT_END] = "present end",
+};
+
+// Evento que abre el span que cierra cada evento de fin
+static const uint32_t span_begin[MAX_EVENT] = {
+	[TRACE_TRAP_EXIT] = TRACE_TRAP_ENTER,
+	[TRACE_PLIC_COMPLETE] = TRACE_PLIC_CLAIM,
+	[TRACE_SCROLLBACK_END] = TRACE_SCROLLBACK_BEGIN,
+	[TRACE_PRESENT_END] = TRACE_PRESENT_BEGIN,
+};
+
+struct span_stats {
+	uint64_t count;
+	uint64_t total;
+	uint64_t max;
+};
+
+static struct span_stats stats[MAX_EVENT];
+static struct trace_record open_spans[MAX_EVENT][MAX_DEPTH];
+static int open_depth[MAX_EVENT];
+
+static
+bool parse_record(const char* line, struct trace_record* out) {
+	uint8_t* bytes = (uint8_t*) out;
+	for (size_t i = 0; i < sizeof(*out); i++) {
+		char byte[3] = { line[2 * i], line[2 * i + 1], 0 };
+		char* end;
+		if (byte[0] == 0 || byte[1] == 0) return false;
+		bytes[i] = strtoul(byte, &end, 16);
+		if (*end != 0) return false;
+	}
+	return true;
+}
+
+static
+double to_us(uint64_t ticks, double timebase) {
+	return ticks * 1e6 / timebase;
+}
+
+int main(int argc, char* argv[]) {
+	FILE* in = stdin;
+	double timebase = 10000000; // QEMU virt
+	if (2 <= argc && strcmp(argv[1], "-") != 0) {
+		in = fopen(argv[1], "r");
+		if (in == NULL) {
+			fprintf(stderr, "FATAL: Couldn't open %s\n", argv[1]);
+			return 1;
+		}
+	}
+	if (3 <= argc) {
+		timebase = atof(argv[2]);
+	}
+
+	char line[256];
+	bool inside = false;
+	bool first = true;
+	uint64_t start_time = 0, prev_time = 0;
+	uint64_t records = 0;
+
+	while (fgets(line, sizeof(line), in)) {
+		if (strncmp(line, "trace: begin", 12) == 0) {
+			inside = true;
+			continue;
+		}
+		if (strncmp(line, "trace: end", 10) == 0) {
+			inside = false;
+			continue;
+		}
+		struct trace_record r;
+		if (!inside || !parse_record(line, &r)) continue;
+
+		if (first) {
+			printf("%12s %10s %14s  %-18s %s\n", "time (us)", "+ (us)", "cycle", "event", "args");
+			start_time = prev_time = r.time;
+			first = false;
+		}
+		const char* name = r.event < MAX_EVENT && event_names[r.event] ? event_names[r.event] : "?";
+		printf("%12.1f %10.1f %14lu  %-18s %u 0x%lx",
+			to_us(r.time - start_time, timebase), to_us(r.time - prev_time, timebase),
+			(unsigned long) r.cycle, name, r.arg0, (unsigned long) r.arg1);
+		prev_time = r.time;
+		records++;
+
+		if (r.event < MAX_EVENT && span_begin[r.event] != 0) {
+			uint32_t begin = span_begin[r.event];
+			if (open_depth[begin] != 0) {
+				struct trace_record* b = &open_spans[begin][--open_depth[begin]];
+				uint64_t took = r.time - b->time;
+				printf("  (%.1f us, %lu cycles)", to_us(took, timebase), (unsigned long) (r.cycle - b->cycle));
+				stats[begin].count++;
+				stats[begin].total += took;
+				if (stats[begin].max < took) stats[begin].max = took;
+			}
+		} else if (r.event < MAX_EVENT && open_depth[r.event] < MAX_DEPTH) {
+			open_spans[r.event][open_depth[r.event]++] = r;
+		}
+		printf("\n");
+	}
+
+	printf("\n%lu records\n", (unsigned long) records);
+	printf("%-18s %8s %12s %12s\n", "span", "count", "avg (us)", "max (us)");
+	for (int i = 0; i < MAX_EVENT; i++) {
+		if (stats[i].count == 0) continue;
+		printf("%-18s %8lu %12.1f %12.1f\n", event_names[i], (unsigned long) stats[i].count,
+			to_us(stats[i].total, timebase) / stats[i].count, to_us(stats[i].max, timebase));
+	}
+	return 0;
+}
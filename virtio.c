@@ -1,6 +1,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "kprintf.h"
 #include "utils.h"
 
 struct virtio_device {
@@ -111,7 +112,7 @@ struct virtio_config_input {
 	};
 };
 
-#define P(field) print("Offset of "#field": "); print_hex(offsetof(struct virtio_device, field)); print("\n")
+#define P(field) kprintf("Offset of "#field": 0x%lX\n", offsetof(struct virtio_device, field))
 
 void test_enumerate() {
 	P(magic);
@@ -151,33 +152,11 @@ void test_enumerate() {
 		//(void*) 0x10001000
 	};
 	for (int i = 0; i < sizeof(devices) / sizeof(devices[0]); i++) {
-		print("Address: ");
-		print_hex((uintptr_t) devices[i]);
-		print("\n");
-
 		uint32_t magic = devices[i]->magic;
-		print("Magic: ");
-		print((char[]) {
-			(magic >>  0) & 0xFF,
-			(magic >>  8) & 0xFF,
-			(magic >> 16) & 0xFF,
-			(magic >> 24) & 0xFF,
-			0
-		});
-		print("\n");
-
-
-		print("Version: ");
-		print_hex(devices[i]->version);
-		print("\n");
-
-		print("Device ID: ");
-		print_hex(devices[i]->device_id);
-		print("\n");
-
-		print("Vendor ID: ");
-		print_hex(devices[i]->vendor_id);
-		print("\n");
+		kprintf(
+			"Address: 0x%lX\nMagic: %.4s\nVersion: 0x%X\nDevice ID: 0x%X\nVendor ID: 0x%X\n",
+			(uintptr_t) devices[i], (char*) &magic, devices[i]->version, devices[i]->device_id, devices[i]->vendor_id
+		);
 
 		if (devices[i]->device_id == 0x12) {
 			struct virtio_config_input* config = (void*) devices[i]->config;
@@ -185,37 +164,27 @@ void test_enumerate() {
 			config->subsel = 0;
 			config->select = VIRTIO_INPUT_CFG_ID_NAME;
 			if (config->size != 0) {
-				print("Name: ");
-				print(config->string);
-				print("\n");
+				kprintf("Name: %s\n", config->string);
 			}
 
 			config->subsel = 0;
 			config->select = VIRTIO_INPUT_CFG_ID_SERIAL;
 			if (config->size != 0) {
-				print("Serial: ");
-				for (int i = 0; i < config->size; i++) {
-					if (i != 0) {
-						print(" ");
-					}
-					print_hex(config->string[i]);
+				char serial[128 * 5];
+				uint64_t used = 0;
+				for (int i = 0; i < config->size && used < sizeof(serial); i++) {
+					used += ksnprintf(serial + used, sizeof(serial) - used, i == 0 ? "0x%X" : " 0x%X", (uint8_t) config->string[i]);
 				}
-				print("\n");
+				kprintf("Serial: %s\n", serial);
 			}
 
 			config->subsel = 0;
 			config->select = VIRTIO_INPUT_CFG_ID_DEVIDS;
 			if (config->size != 0) {
-				print("Device IDs:");
-				print("\n - Bus type: ");
-				print_hex(config->ids.bustype);
-				print("\n - Vendor: ");
-				print_hex(config->ids.vendor);
-				print("\n - Product: ");
-				print_hex(config->ids.product);
-				print("\n - Version: ");
-				print_hex(config->ids.bustype);
-				print("\n");
+				kprintf(
+					"Device IDs:\n - Bus type: 0x%X\n - Vendor: 0x%X\n - Product: 0x%X\n - Version: 0x%X\n",
+					config->ids.bustype, config->ids.vendor, config->ids.product, config->ids.verstion
+				);
 			}
 		}
 		print("\n");
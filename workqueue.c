@@ -0,0 +1,78 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "workqueue.h"
+
+#define WORK_SLOTS 256
+
+// `seq` dice en qué vuelta está el slot: en la vuelta `lap` vale 2 * lap
+// cuando está libre y 2 * lap + 1 cuando tiene trabajo publicado. Así la
+// cola arranca vacía con el bss en cero. Los productores se pelean por
+// head con un CAS, work_run es el único consumidor y el único que toca
+// work_tail.
+struct work_slot {
+	uint64_t seq;
+	work_fn fn;
+	uint64_t arg;
+};
+
+static struct work_slot work_ring[WORK_SLOTS];
+static uint64_t work_head;
+static uint64_t work_tail;
+static uint64_t work_lost;
+
+bool work_queue(work_fn fn, uint64_t arg) {
+	uint64_t pos = __atomic_load_n(&work_head, __ATOMIC_RELAXED);
+	struct work_slot* slot;
+	while (true) {
+		slot = &work_ring[pos % WORK_SLOTS];
+		uint64_t lap = pos / WORK_SLOTS;
+		uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if (seq == 2 * lap) {
+			if (__atomic_compare_exchange_n(&work_head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if (seq < 2 * lap) {
+			// Lo de la vuelta anterior todavía no corrió: está llena
+			__atomic_fetch_add(&work_lost, 1, __ATOMIC_RELAXED);
+			return false;
+		} else {
+			pos = __atomic_load_n(&work_head, __ATOMIC_RELAXED);
+		}
+	}
+
+	slot->fn = fn;
+	slot->arg = arg;
+	__atomic_store_n(&slot->seq, 2 * (pos / WORK_SLOTS) + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+uint32_t work_run(void) {
+	uint32_t ran = 0;
+	// Lo que se encole mientras tanto queda para la próxima
+	uint64_t head = __atomic_load_n(&work_head, __ATOMIC_ACQUIRE);
+	while (work_tail != head) {
+		struct work_slot* slot = &work_ring[work_tail % WORK_SLOTS];
+		uint64_t lap = work_tail / WORK_SLOTS;
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != 2 * lap + 1) {
+			break;
+		}
+		work_fn fn = slot->fn;
+		uint64_t arg = slot->arg;
+		// Se libera antes de correrlo, así el trabajo puede encolar más
+		__atomic_store_n(&slot->seq, 2 * lap + 2, __ATOMIC_RELEASE);
+		work_tail++;
+
+		fn(arg);
+		ran++;
+	}
+	return ran;
+}
+
+bool work_pending(void) {
+	return __atomic_load_n(&work_head, __ATOMIC_ACQUIRE) != __atomic_load_n(&work_tail, __ATOMIC_RELAXED);
+}
+
+uint64_t work_dropped(void) {
+	return work_lost;
+}
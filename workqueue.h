@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Bottom halves. Interrupt handlers queue a function and its argument and
+// return; the main loop runs them later with interrupts enabled.
+typedef void (*work_fn)(uint64_t arg);
+
+// Safe from any context and never blocks. Returns false (and counts the
+// drop) if the queue is full.
+bool work_queue(work_fn fn, uint64_t arg);
+// Runs everything queued so far, in order, and returns how many ran. Only
+// call it from one place outside interrupt context (the idle loop).
+uint32_t work_run(void);
+bool work_pending(void);
+// Work lost because the queue was full
+uint64_t work_dropped(void);